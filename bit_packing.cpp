@@ -0,0 +1,114 @@
+#include "bit_packing.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BIT_PACKING_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const size_t LANE_COUNT = 4;
+const size_t VALUES_PER_LANE = BIT_PACKING_BLOCK_SIZE / LANE_COUNT;
+
+uint32_t GetBitMask(uint32_t bit_width) {
+    return bit_width == 32 ? ~uint32_t{ 0 } : (uint32_t{ 1 } << bit_width) - 1;
+}
+
+#ifdef BIT_PACKING_SSE2
+void UnpackBlockSse2(const uint32_t* in, uint32_t bit_width, uint32_t* values) {
+    const __m128i* in_words = reinterpret_cast<const __m128i*>(in);
+    __m128i* out_values = reinterpret_cast<__m128i*>(values);
+    const __m128i mask = _mm_set1_epi32(static_cast<int>(GetBitMask(bit_width)));
+
+    __m128i word = _mm_loadu_si128(in_words++);
+    uint32_t shift = 0;
+    for (size_t i = 0; i < VALUES_PER_LANE; ++i) {
+        __m128i value = _mm_srl_epi32(word, _mm_cvtsi32_si128(static_cast<int>(shift)));
+        shift += bit_width;
+        if (shift >= 32) {
+            shift -= 32;
+            if (i + 1 < VALUES_PER_LANE || shift > 0) {
+                word = _mm_loadu_si128(in_words++);
+            }
+            if (shift > 0) {
+                value = _mm_or_si128(value, _mm_sll_epi32(word, _mm_cvtsi32_si128(static_cast<int>(bit_width - shift))));
+            }
+        }
+        _mm_storeu_si128(out_values + i, _mm_and_si128(value, mask));
+    }
+}
+#endif
+
+} // namespace
+
+uint32_t GetRequiredBitWidth(const uint32_t* values) {
+    uint32_t combined = 0;
+    for (size_t i = 0; i < BIT_PACKING_BLOCK_SIZE; ++i) {
+        combined |= values[i];
+    }
+    uint32_t bit_width = 0;
+    while (combined != 0) {
+        ++bit_width;
+        combined >>= 1;
+    }
+    return bit_width;
+}
+
+size_t GetPackedWordCount(uint32_t bit_width) {
+    return LANE_COUNT * bit_width;
+}
+
+void PackBlock(const uint32_t* values, uint32_t bit_width, uint32_t* out) {
+    for (size_t word = 0; word < GetPackedWordCount(bit_width); ++word) {
+        out[word] = 0;
+    }
+    if (bit_width == 0) {
+        return;
+    }
+    for (size_t lane = 0; lane < LANE_COUNT; ++lane) {
+        size_t bit_position = 0;
+        for (size_t i = 0; i < VALUES_PER_LANE; ++i, bit_position += bit_width) {
+            const uint32_t value = values[i * LANE_COUNT + lane];
+            const size_t word = bit_position / 32;
+            const uint32_t shift = bit_position % 32;
+            out[word * LANE_COUNT + lane] |= value << shift;
+            if (shift + bit_width > 32) {
+                out[(word + 1) * LANE_COUNT + lane] |= value >> (32 - shift);
+            }
+        }
+    }
+}
+
+void UnpackBlockScalar(const uint32_t* in, uint32_t bit_width, uint32_t* values) {
+    if (bit_width == 0) {
+        for (size_t i = 0; i < BIT_PACKING_BLOCK_SIZE; ++i) {
+            values[i] = 0;
+        }
+        return;
+    }
+    const uint32_t mask = GetBitMask(bit_width);
+    for (size_t lane = 0; lane < LANE_COUNT; ++lane) {
+        size_t bit_position = 0;
+        for (size_t i = 0; i < VALUES_PER_LANE; ++i, bit_position += bit_width) {
+            const size_t word = bit_position / 32;
+            const uint32_t shift = bit_position % 32;
+            uint32_t value = in[word * LANE_COUNT + lane] >> shift;
+            if (shift + bit_width > 32) {
+                value |= in[(word + 1) * LANE_COUNT + lane] << (32 - shift);
+            }
+            values[i * LANE_COUNT + lane] = value & mask;
+        }
+    }
+}
+
+void UnpackBlock(const uint32_t* in, uint32_t bit_width, uint32_t* values) {
+#ifdef BIT_PACKING_SSE2
+    if (bit_width > 0) {
+        UnpackBlockSse2(in, bit_width, values);
+        return;
+    }
+#endif
+    UnpackBlockScalar(in, bit_width, values);
+}
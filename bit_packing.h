@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Binary packing of blocks of 128 unsigned integers in the vertical SIMD-BP128 layout:
+// value i is stored in 32-bit lane i % 4, so a block packed with bit width b takes 4 * b words
+// and four values are unpacked at once. SSE2 is used when the target has it, plain C++ otherwise.
+
+const size_t BIT_PACKING_BLOCK_SIZE = 128;
+
+// Number of bits needed to store the largest of BIT_PACKING_BLOCK_SIZE values
+uint32_t GetRequiredBitWidth(const uint32_t* values);
+
+size_t GetPackedWordCount(uint32_t bit_width);
+
+// Writes GetPackedWordCount(bit_width) words to out
+void PackBlock(const uint32_t* values, uint32_t bit_width, uint32_t* out);
+
+// Reads GetPackedWordCount(bit_width) words from in and writes BIT_PACKING_BLOCK_SIZE values
+void UnpackBlock(const uint32_t* in, uint32_t bit_width, uint32_t* values);
+
+void UnpackBlockScalar(const uint32_t* in, uint32_t bit_width, uint32_t* values);
@@ -0,0 +1,99 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+// Multi-producer multi-consumer FIFO of limited capacity.
+// Push blocks while the queue is full, so a fast producer is held back to the pace of its consumers.
+// Once the queue is closed, Push drops its item and Pop drains the remaining items and then returns nothing.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(capacity > 0 ? capacity : 1) {
+    }
+
+    // Returns false if the queue was closed before the item could be queued
+    bool Push(T item) {
+        std::unique_lock lock(mutex_);
+        not_full_.wait(lock, [this]() {
+            return is_closed_ || items_.size() < capacity_;
+            });
+        if (is_closed_) {
+            return false;
+        }
+        items_.push_back(std::move(item));
+        lock.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Never blocks: moves the item in if there is room, otherwise returns false and leaves the item to the caller
+    bool TryPush(T& item) {
+        {
+            std::lock_guard lock(mutex_);
+            if (is_closed_ || items_.size() >= capacity_) {
+                return false;
+            }
+            items_.push_back(std::move(item));
+        }
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Waits for an item, returns nothing once the queue is closed and empty
+    std::optional<T> Pop() {
+        std::unique_lock lock(mutex_);
+        not_empty_.wait(lock, [this]() {
+            return is_closed_ || !items_.empty();
+            });
+        if (items_.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(items_.front());
+        items_.pop_front();
+        lock.unlock();
+        not_full_.notify_one();
+        return item;
+    }
+
+    void Close() {
+        {
+            std::lock_guard lock(mutex_);
+            is_closed_ = true;
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+    // Closes the queue and drops the items still in it
+    void Cancel() {
+        {
+            std::lock_guard lock(mutex_);
+            is_closed_ = true;
+            items_.clear();
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard lock(mutex_);
+        return items_.size();
+    }
+
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+
+private:
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+    bool is_closed_ = false;
+};
@@ -6,6 +6,8 @@
 
 using namespace std::string_literals;
 
+// Map split into buckets with a mutex each. The server itself does not use it: its parallel scoring and batch
+// ingestion work on ranges of ordinals that share nothing, and merge the results of the ranges at the end.
 template <typename Key, typename Value>
 class ConcurrentMap {
 public:
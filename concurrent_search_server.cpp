@@ -0,0 +1,123 @@
+#include <atomic>
+#include <utility>
+
+#include "concurrent_search_server.h"
+
+using namespace std;
+
+ConcurrentSearchServer::Snapshot::Snapshot(const ConcurrentSearchServer* owner, size_t slot)
+    : owner_(owner)
+    , slot_(slot)
+    , search_server_(owner->versions_[slot].get()) {
+}
+
+ConcurrentSearchServer::Snapshot::Snapshot(Snapshot&& other) noexcept
+    : owner_(exchange(other.owner_, nullptr))
+    , slot_(other.slot_)
+    , search_server_(other.search_server_) {
+}
+
+ConcurrentSearchServer::Snapshot::~Snapshot() {
+    if (owner_) {
+        owner_->ReleaseSlot(slot_);
+    }
+}
+
+ConcurrentSearchServer::Snapshot ConcurrentSearchServer::GetSnapshot() const {
+    // Sequentially consistent, so either the writer sees this reader in the counter before it takes the slot
+    // back, or this reader sees the slot has been replaced and leaves it untouched
+    while (true) {
+        const size_t slot = published_slot_.load();
+        reader_counts_[slot].value.fetch_add(1);
+        if (published_slot_.load() == slot) {
+            return Snapshot(this, slot);
+        }
+        ReleaseSlot(slot);
+    }
+}
+
+int ConcurrentSearchServer::GetDocumentCount() const {
+    return GetSnapshot()->GetDocumentCount();
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    ApplyWrite([document_id, document = string(document), status, ratings](SearchServer& search_server) {
+        search_server.AddDocument(document_id, document, status, ratings);
+        });
+}
+
+void ConcurrentSearchServer::AddDocuments(const vector<DocumentInput>& documents) {
+    // The replay happens after the caller's texts may be gone, so the write owns copies of them
+    auto texts = make_shared<vector<string>>();
+    auto owned_documents = make_shared<vector<DocumentInput>>(documents);
+    texts->reserve(documents.size());
+    for (DocumentInput& document : *owned_documents) {
+        document.text = texts->emplace_back(document.text);
+    }
+    ApplyWrite([texts, owned_documents](SearchServer& search_server) {
+        search_server.AddDocuments(*owned_documents);
+        });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    ApplyWrite([document_id](SearchServer& search_server) {
+        search_server.RemoveDocument(document_id);
+        });
+}
+
+void ConcurrentSearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    ApplyWrite([document_ids](SearchServer& search_server) {
+        search_server.RemoveDocuments(document_ids);
+        });
+}
+
+void ConcurrentSearchServer::CompactIndex() {
+    ApplyWrite([](SearchServer& search_server) {
+        search_server.CompactIndex();
+        });
+}
+
+void ConcurrentSearchServer::SetWorkerCount(size_t worker_count) {
+    auto pool = make_shared<WorkStealingPool>(worker_count);
+    ApplyWrite([pool](SearchServer& search_server) {
+        search_server.SetPool(pool);
+        });
+}
+
+void ConcurrentSearchServer::SetResultCacheCapacity(size_t capacity) {
+    ApplyWrite([capacity](SearchServer& search_server) {
+        search_server.SetResultCacheCapacity(capacity);
+        });
+}
+
+void ConcurrentSearchServer::ReleaseSlot(size_t slot) const {
+    // Readers of the published slot never touch the mutex, only the last reader of a replaced one wakes the writer
+    if (reader_counts_[slot].value.fetch_sub(1) == 1 && published_slot_.load() != slot) {
+        lock_guard lock(release_mutex_);
+        release_condition_.notify_all();
+    }
+}
+
+void ConcurrentSearchServer::WaitForReaders(size_t slot) {
+    unique_lock lock(release_mutex_);
+    release_condition_.wait(lock, [this, slot] {
+        return reader_counts_[slot].value.load() == 0;
+        });
+}
+
+void ConcurrentSearchServer::ApplyWrite(Write write) {
+    lock_guard lock(write_mutex_);
+
+    const size_t standby_slot = 1 - published_slot_.load(memory_order_relaxed);
+    SearchServer& standby = *versions_[standby_slot];
+    WaitForReaders(standby_slot);
+    for (const Write& missed_write : missed_writes_) {
+        missed_write(standby);
+    }
+    missed_writes_.clear();
+
+    // Both versions hold the same documents here, a rejected write leaves them that way
+    write(standby);
+    published_slot_.store(standby_slot);
+    missed_writes_.push_back(move(write));
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "search_server.h"
+
+// SearchServer that can be read and written at the same time.
+// Readers work on a published version of the index without taking locks and never wait for writers.
+// Two versions are kept: a write is applied to the unpublished one, which is then published with an atomic
+// store of its slot. Every version has a counter of the readers holding it. The version it replaces goes back
+// to the writer once that counter drops to zero, and the writes it has missed are replayed on it before the
+// next write. Writes are serialized, a write only waits for the readers of the version it takes back and
+// sleeps on a condition variable meanwhile, which the last of those readers signals.
+class ConcurrentSearchServer {
+public:
+    // Consistent version of the index. It does not change while it is held,
+    // so several reads through it see the same documents. It must not outlive the server.
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& other) noexcept;
+
+        Snapshot& operator=(Snapshot&&) = delete;
+
+        ~Snapshot();
+
+        const SearchServer& operator*() const {
+            return *search_server_;
+        }
+
+        const SearchServer* operator->() const {
+            return search_server_;
+        }
+
+    private:
+        friend class ConcurrentSearchServer;
+
+        // Null once moved from
+        const ConcurrentSearchServer* owner_;
+        size_t slot_;
+        const SearchServer* search_server_;
+
+        Snapshot(const ConcurrentSearchServer* owner, size_t slot);
+    };
+
+    template <typename StopWords>
+    explicit ConcurrentSearchServer(const StopWords& stop_words);
+
+    ConcurrentSearchServer(const ConcurrentSearchServer&) = delete;
+
+    ConcurrentSearchServer& operator=(const ConcurrentSearchServer&) = delete;
+
+    // Takes no lock: it registers in the reader counter of the published slot and retries
+    // only if a write has published the other slot meanwhile
+    Snapshot GetSnapshot() const;
+
+    // Take the same arguments as the SearchServer methods and read the current version
+    template <typename... Args>
+    std::vector<Document> FindTopDocuments(Args&&... args) const {
+        return GetSnapshot()->FindTopDocuments(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    SearchServer::MatchDocumentResult MatchDocument(Args&&... args) const {
+        return GetSnapshot()->MatchDocument(std::forward<Args>(args)...);
+    }
+
+    int GetDocumentCount() const;
+
+    // Writes are visible to every GetSnapshot call that starts after they return.
+    // A rejected write throws as the SearchServer method does and changes nothing.
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void AddDocuments(const std::vector<DocumentInput>& documents);
+
+    void RemoveDocument(int document_id);
+
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Merges run on the unpublished version, readers keep the published one meanwhile
+    void CompactIndex();
+
+    // Both versions run on one pool of worker_count threads
+    void SetWorkerCount(size_t worker_count);
+
+    void SetResultCacheCapacity(size_t capacity);
+
+private:
+    using Write = std::function<void(SearchServer&)>;
+
+    // Readers of one slot share a counter, kept on a cache line of its own
+    struct alignas(64) ReaderCount {
+        std::atomic<int64_t> value{ 0 };
+    };
+
+    // Both versions, only the unpublished one is ever written
+    std::array<std::unique_ptr<SearchServer>, 2> versions_;
+    std::atomic<size_t> published_slot_{ 0 };
+    mutable std::array<ReaderCount, 2> reader_counts_;
+    // Signalled by the last reader leaving a slot that is no longer published
+    mutable std::mutex release_mutex_;
+    mutable std::condition_variable release_condition_;
+    // Writes applied to the published version but not yet to the other one, guarded by write_mutex_
+    std::vector<Write> missed_writes_;
+    std::mutex write_mutex_;
+
+    void ReleaseSlot(size_t slot) const;
+
+    // Blocks until no reader holds the slot
+    void WaitForReaders(size_t slot);
+
+    void ApplyWrite(Write write);
+};
+
+template <typename StopWords>
+ConcurrentSearchServer::ConcurrentSearchServer(const StopWords& stop_words)
+    : versions_{ std::make_unique<SearchServer>(stop_words), std::make_unique<SearchServer>(stop_words) } {
+}
@@ -8,6 +8,12 @@ Document::Document(int id, double relevance, int rating)
     , rating(rating) {
 }
 
+ResultCursor::ResultCursor(const Document& last_document)
+    : relevance(last_document.relevance)
+    , rating(last_document.rating)
+    , document_id(last_document.id) {
+}
+
 ostream& operator<<(ostream& out, const Document& document) {
     out << "{ "s
         << "document_id = "s << document.id << ", "s
@@ -1,5 +1,8 @@
 #pragma once
 #include <iostream>
+#include <cmath>
+#include <string_view>
+#include <vector>
 
 struct Document {
     Document() = default;
@@ -13,9 +16,47 @@ struct Document {
 
 std::ostream& operator<<(std::ostream& out, const Document& document);
 
+// Relevances closer than this are considered equal, then the higher rating wins
+const double RELEVANCE_EPSILON = 1e-6;
+
+// Orders documents from the most relevant to the least relevant. The remaining ties go to the lower id,
+// so every document of a result list has one fixed position: equal results come out in the same order
+// on every run, and pages cut from the list neither overlap nor skip documents.
+struct DocumentRelevanceGreater {
+    bool operator()(const Document& lhs, const Document& rhs) const {
+        if (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_EPSILON) {
+            if (lhs.rating != rhs.rating) {
+                return lhs.rating > rhs.rating;
+            }
+            return lhs.id < rhs.id;
+        }
+        return lhs.relevance > rhs.relevance;
+    }
+};
+
+// Position in a result list ranked by DocumentRelevanceGreater, made from the last document of a page.
+// It holds plain values, so it can be handed to a client and brought back with the request for the next page.
+struct ResultCursor {
+    ResultCursor() = default;
+
+    explicit ResultCursor(const Document& last_document);
+
+    double relevance = 0.0;
+    int rating = 0;
+    int document_id = 0;
+};
+
 enum class DocumentStatus {
     ACTUAL,
     IRRELEVANT,
     BANNED,
     REMOVED,
+};
+
+// A document of an AddDocuments batch, the text has to stay alive only during the call
+struct DocumentInput {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
 };
\ No newline at end of file
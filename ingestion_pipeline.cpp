@@ -0,0 +1,331 @@
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "ingestion_pipeline.h"
+#include "snapshot.h"
+
+using namespace std;
+
+namespace {
+
+int ParseInt(string_view text, string_view field_name) {
+    int value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (error != errc() || end != text.data() + text.size() || text.empty()) {
+        throw invalid_argument("Invalid "s + string(field_name) + " \""s + string(text) + "\""s);
+    }
+    return value;
+}
+
+DocumentStatus ParseStatus(string_view text) {
+    if (text == "ACTUAL"sv) {
+        return DocumentStatus::ACTUAL;
+    }
+    if (text == "IRRELEVANT"sv) {
+        return DocumentStatus::IRRELEVANT;
+    }
+    if (text == "BANNED"sv) {
+        return DocumentStatus::BANNED;
+    }
+    if (text == "REMOVED"sv) {
+        return DocumentStatus::REMOVED;
+    }
+    throw invalid_argument("Invalid status \""s + string(text) + "\""s);
+}
+
+// Cuts the next tab-separated field off the line
+string_view TakeField(string_view& line, string_view field_name) {
+    const size_t tab = line.find('\t');
+    if (tab == line.npos) {
+        throw invalid_argument("Missing "s + string(field_name));
+    }
+    const string_view field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return field;
+}
+
+// Length of the prefix of text that ends with the last line end within the first limit bytes, 0 if there is none
+size_t FindChunkEnd(string_view text, size_t limit) {
+    if (text.size() <= limit) {
+        return text.size();
+    }
+    const size_t line_end = text.rfind('\n', limit - 1);
+    return line_end == text.npos ? 0 : line_end + 1;
+}
+
+} // namespace
+
+DocumentInput ParseDocumentLine(string_view line) {
+    DocumentInput document;
+    document.id = ParseInt(TakeField(line, "id"sv), "id"sv);
+    document.status = ParseStatus(TakeField(line, "status"sv));
+    string_view ratings = TakeField(line, "ratings"sv);
+    // Every comma has to be followed by a rating, so "5,-2," is rejected
+    for (bool has_next = !ratings.empty(); has_next;) {
+        const size_t comma = ratings.find(',');
+        document.ratings.push_back(ParseInt(ratings.substr(0, comma), "rating"sv));
+        has_next = comma != ratings.npos;
+        ratings.remove_prefix(has_next ? comma + 1 : ratings.size());
+    }
+    document.text = line;
+    return document;
+}
+
+struct IngestionPipeline::InputChunk {
+    uint64_t sequence;
+    // Owns the text of a chunk read from a stream; a chunk of a file keeps the mapped file alive
+    shared_ptr<const void> storage;
+    string_view text;
+    // Position of the text in the input, for error messages
+    uint64_t offset;
+};
+
+struct IngestionPipeline::Stages {
+    struct ParsedChunk {
+        uint64_t sequence;
+        shared_ptr<const void> storage;
+        SearchServer::PreparedDocuments documents;
+    };
+
+    explicit Stages(size_t queue_capacity)
+        : read_queue(queue_capacity)
+        , parsed_queue(queue_capacity)
+        , window_size(read_queue.GetCapacity()) {
+    }
+
+    BoundedQueue<InputChunk> read_queue;
+    BoundedQueue<ParsedChunk> parsed_queue;
+    const chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+    atomic<int64_t> elapsed_nanoseconds{ -1 };
+    atomic<uint64_t> document_count{ 0 };
+    atomic<uint64_t> byte_count{ 0 };
+    uint64_t next_sequence = 0;
+
+    // The reader stays less than window_size chunks ahead of the next chunk the writer adds, so a parser
+    // stuck on a large chunk cannot make the writer hold an unbounded number of later chunks
+    const uint64_t window_size;
+    mutex window_mutex;
+    condition_variable window_moved;
+    uint64_t written_sequence = 0;
+    bool is_stopped = false;
+
+    // Only the reader pushes chunks
+    bool PushChunk(shared_ptr<const void> storage, string_view text, uint64_t offset) {
+        {
+            unique_lock lock(window_mutex);
+            window_moved.wait(lock, [this]() {
+                return is_stopped || next_sequence < written_sequence + window_size;
+                });
+            if (is_stopped) {
+                return false;
+            }
+        }
+        byte_count += text.size();
+        return read_queue.Push({ next_sequence++, move(storage), text, offset });
+    }
+
+    void MarkWritten() {
+        {
+            lock_guard lock(window_mutex);
+            ++written_sequence;
+        }
+        window_moved.notify_one();
+    }
+
+    void Stop() {
+        {
+            lock_guard lock(window_mutex);
+            is_stopped = true;
+        }
+        window_moved.notify_all();
+        read_queue.Cancel();
+        parsed_queue.Cancel();
+    }
+};
+
+IngestionPipeline::IngestionPipeline(SearchServer& search_server, IngestionOptions options)
+    : search_server_(search_server)
+    , options_(move(options)) {
+}
+
+void IngestionPipeline::LoadFile(const string& path) {
+    const auto file = make_shared<MappedFile>(path);
+    Run([this, &file](Stages& stages) {
+        const string_view input(file->data(), file->size());
+        size_t offset = 0;
+        while (offset < input.size()) {
+            const string_view rest = input.substr(offset);
+            size_t chunk_size = FindChunkEnd(rest, options_.chunk_size);
+            if (chunk_size == 0) {
+                // A line longer than a chunk makes a chunk of its own
+                const size_t line_end = rest.find('\n');
+                chunk_size = line_end == rest.npos ? rest.size() : line_end + 1;
+            }
+            if (!stages.PushChunk(file, rest.substr(0, chunk_size), offset)) {
+                return;
+            }
+            offset += chunk_size;
+        }
+        });
+}
+
+void IngestionPipeline::LoadStream(istream& input) {
+    Run([this, &input](Stages& stages) {
+        string carry;
+        uint64_t offset = 0;
+        bool is_end = false;
+        while (!is_end) {
+            auto buffer = make_shared<string>(move(carry));
+            carry.clear();
+            const size_t carried_size = buffer->size();
+            buffer->resize(carried_size + options_.chunk_size);
+            input.read(buffer->data() + carried_size, static_cast<streamsize>(options_.chunk_size));
+            buffer->resize(carried_size + static_cast<size_t>(input.gcount()));
+            is_end = !input;
+            if (!is_end) {
+                // The incomplete last line goes to the next chunk
+                const size_t line_end = buffer->rfind('\n');
+                const size_t chunk_size = line_end == buffer->npos ? 0 : line_end + 1;
+                carry.assign(*buffer, chunk_size);
+                buffer->resize(chunk_size);
+            }
+            if (buffer->empty()) {
+                continue;
+            }
+            const string_view text(*buffer);
+            if (!stages.PushChunk(buffer, text, offset)) {
+                return;
+            }
+            offset += text.size();
+        }
+        });
+}
+
+IngestionStats IngestionPipeline::GetStats() const {
+    const shared_ptr<Stages> stages = atomic_load(&stages_);
+    IngestionStats stats;
+    if (!stages) {
+        return stats;
+    }
+    stats.document_count = stages->document_count;
+    stats.byte_count = stages->byte_count;
+    const int64_t elapsed_nanoseconds = stages->elapsed_nanoseconds;
+    stats.elapsed = elapsed_nanoseconds >= 0
+        ? chrono::nanoseconds(elapsed_nanoseconds)
+        : chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - stages->start_time);
+    if (stats.elapsed.count() > 0) {
+        stats.documents_per_second = stats.document_count / chrono::duration<double>(stats.elapsed).count();
+    }
+    stats.read_queue_depth = stages->read_queue.size();
+    stats.parsed_queue_depth = stages->parsed_queue.size();
+    return stats;
+}
+
+void IngestionPipeline::Run(const function<void(Stages& stages)>& read) {
+    const auto stages = make_shared<Stages>(options_.queue_capacity);
+    atomic_store(&stages_, stages);
+
+    mutex error_mutex;
+    exception_ptr error;
+    // The first error stops every stage, chunks still queued are dropped
+    const auto fail = [&](exception_ptr stage_error) {
+        {
+            lock_guard lock(error_mutex);
+            if (!error) {
+                error = stage_error;
+            }
+        }
+        stages->Stop();
+    };
+
+    thread reader([&]() {
+        try {
+            read(*stages);
+        }
+        catch (...) {
+            fail(current_exception());
+        }
+        stages->read_queue.Close();
+        });
+
+    const size_t parser_count = max<size_t>(options_.parser_count, 1);
+    atomic<size_t> running_parsers{ parser_count };
+    vector<thread> parsers;
+    for (size_t i = 0; i < parser_count; ++i) {
+        parsers.emplace_back([&]() {
+            try {
+                while (auto chunk = stages->read_queue.Pop()) {
+                    vector<DocumentInput> documents;
+                    string_view text = chunk->text;
+                    while (!text.empty()) {
+                        const size_t line_end = text.find('\n');
+                        string_view line = text.substr(0, line_end);
+                        const uint64_t line_offset = chunk->offset + (text.data() - chunk->text.data());
+                        text.remove_prefix(line_end == text.npos ? text.size() : line_end + 1);
+                        if (!line.empty() && line.back() == '\r') {
+                            line.remove_suffix(1);
+                        }
+                        if (line.empty()) {
+                            continue;
+                        }
+                        try {
+                            documents.push_back(ParseDocumentLine(line));
+                        }
+                        catch (const invalid_argument& parse_error) {
+                            throw invalid_argument("Line at byte "s + to_string(line_offset) + ": "s + parse_error.what());
+                        }
+                    }
+                    Stages::ParsedChunk parsed{ chunk->sequence, move(chunk->storage), search_server_.PrepareDocuments(move(documents)) };
+                    if (!stages->parsed_queue.Push(move(parsed))) {
+                        break;
+                    }
+                }
+            }
+            catch (...) {
+                fail(current_exception());
+            }
+            if (--running_parsers == 0) {
+                stages->parsed_queue.Close();
+            }
+            });
+    }
+
+    // Parsers finish chunks out of order, the writer adds them in input order
+    try {
+        map<uint64_t, Stages::ParsedChunk> waiting_chunks;
+        uint64_t next_sequence = 0;
+        while (auto parsed = stages->parsed_queue.Pop()) {
+            waiting_chunks.emplace(parsed->sequence, move(*parsed));
+            for (auto it = waiting_chunks.begin(); it != waiting_chunks.end() && it->first == next_sequence; it = waiting_chunks.erase(it)) {
+                const size_t document_count = it->second.documents.size();
+                search_server_.AddPreparedDocuments(move(it->second.documents));
+                stages->document_count += document_count;
+                stages->MarkWritten();
+                ++next_sequence;
+                if (options_.on_progress) {
+                    options_.on_progress(GetStats());
+                }
+            }
+        }
+    }
+    catch (...) {
+        fail(current_exception());
+    }
+
+    reader.join();
+    for (thread& parser : parsers) {
+        parser.join();
+    }
+    stages->elapsed_nanoseconds = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - stages->start_time).count();
+    if (error) {
+        rethrow_exception(error);
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "document.h"
+#include "search_server.h"
+
+// Parses one input line: id, status, ratings and text separated by tabs, e.g. "17\tACTUAL\t5,-2,3\tfluffy cat".
+// The status is ACTUAL, IRRELEVANT, BANNED or REMOVED, the ratings are comma-separated and may be empty.
+// The text is the rest of the line and the returned document points into it.
+// Throws std::invalid_argument if the line does not follow the format.
+DocumentInput ParseDocumentLine(std::string_view line);
+
+struct IngestionStats {
+    uint64_t document_count = 0;
+    uint64_t byte_count = 0;
+    std::chrono::nanoseconds elapsed{ 0 };
+    double documents_per_second = 0.0;
+    // Chunks waiting for a parser and parsed chunks waiting for the index writer
+    size_t read_queue_depth = 0;
+    size_t parsed_queue_depth = 0;
+};
+
+struct IngestionOptions {
+    // Input is cut into chunks of about this many bytes, always at the end of a line
+    size_t chunk_size = size_t{ 1 } << 20;
+    size_t parser_count = 2;
+    // Chunks every queue holds before the stage feeding it has to wait. The reader also waits
+    // while it is this many chunks ahead of the index writer.
+    size_t queue_capacity = 8;
+    // Called by the index writer after every chunk it has added
+    std::function<void(const IngestionStats&)> on_progress;
+};
+
+// Loads documents in the ParseDocumentLine format into a server with three stages running at the same time:
+// a reader cutting the input into chunks, parsers that parse and tokenize chunks with PrepareDocuments,
+// and the calling thread adding the prepared chunks in input order. The stages are joined by bounded queues,
+// so a slow index writer holds the reader back instead of letting chunks pile up.
+// Documents get the same ordinals and term ids as when added one by one in input order.
+class IngestionPipeline {
+public:
+    explicit IngestionPipeline(SearchServer& search_server, IngestionOptions options = {});
+
+    // Returns once the whole input is added. If a line is malformed or the server rejects a document,
+    // the exception is rethrown here; documents of the chunks added before stay in the server.
+    void LoadFile(const std::string& path);
+
+    void LoadStream(std::istream& input);
+
+    // May be called from another thread while a load is running
+    IngestionStats GetStats() const;
+
+private:
+    struct InputChunk;
+    struct Stages;
+
+    SearchServer& search_server_;
+    IngestionOptions options_;
+    // Stages of the running or the last load, only accessed with std::atomic_load and std::atomic_store
+    std::shared_ptr<Stages> stages_;
+
+    void Run(const std::function<void(Stages& stages)>& read);
+};
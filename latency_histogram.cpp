@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cmath>
+
+#include "latency_histogram.h"
+
+using namespace std;
+
+namespace {
+
+int GetHighestBit(uint64_t value) {
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+}
+
+} // namespace
+
+size_t LatencyHistogram::GetBucket(uint64_t latency) {
+    const uint64_t sub_bucket_count = uint64_t{ 1 } << SUB_BUCKET_BITS;
+    latency = min(latency, MAX_LATENCY);
+    if (latency < sub_bucket_count) {
+        return static_cast<size_t>(latency);
+    }
+    const int shift = GetHighestBit(latency) - SUB_BUCKET_BITS;
+    // latency >> shift is in [sub_bucket_count, 2 * sub_bucket_count), every shift adds a row of sub-buckets
+    return static_cast<size_t>(shift) * sub_bucket_count + static_cast<size_t>(latency >> shift);
+}
+
+uint64_t LatencyHistogram::GetBucketEnd(size_t bucket) {
+    const size_t sub_bucket_count = size_t{ 1 } << SUB_BUCKET_BITS;
+    if (bucket < 2 * sub_bucket_count) {
+        return bucket;
+    }
+    const size_t shift = bucket / sub_bucket_count - 1;
+    const uint64_t first_value = static_cast<uint64_t>(bucket % sub_bucket_count + sub_bucket_count) << shift;
+    return first_value + (uint64_t{ 1 } << shift) - 1;
+}
+
+void LatencyHistogram::Add(chrono::nanoseconds latency) {
+    const uint64_t value = min(static_cast<uint64_t>(max<int64_t>(latency.count(), 0)), MAX_LATENCY);
+    AddToBucket(GetBucket(value), 1);
+    AddTotals(value, value);
+}
+
+void LatencyHistogram::AddToBucket(size_t bucket, uint64_t count) {
+    bucket_counts_[bucket] += count;
+    count_ += count;
+}
+
+void LatencyHistogram::AddTotals(uint64_t sum, uint64_t max) {
+    sum_ += sum;
+    max_ = std::max(max_, max);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        bucket_counts_[bucket] += other.bucket_counts_[bucket];
+    }
+    count_ += other.count_;
+    AddTotals(other.sum_, other.max_);
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return count_;
+}
+
+chrono::nanoseconds LatencyHistogram::GetSum() const {
+    return chrono::nanoseconds(sum_);
+}
+
+chrono::nanoseconds LatencyHistogram::GetMax() const {
+    return chrono::nanoseconds(max_);
+}
+
+chrono::nanoseconds LatencyHistogram::GetMean() const {
+    return count_ == 0 ? chrono::nanoseconds(0) : chrono::nanoseconds(sum_ / count_);
+}
+
+chrono::nanoseconds LatencyHistogram::GetPercentile(double percentile) const {
+    if (count_ == 0) {
+        return chrono::nanoseconds(0);
+    }
+    // The smallest latency with at least rank latencies at or below it
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(clamp(percentile, 0.0, 100.0) / 100.0 * count_)));
+    uint64_t seen_count = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen_count += bucket_counts_[bucket];
+        if (seen_count >= rank) {
+            return chrono::nanoseconds(GetBucketEnd(bucket));
+        }
+    }
+    return chrono::nanoseconds(GetBucketEnd(BUCKET_COUNT - 1));
+}
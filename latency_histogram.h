@@ -0,0 +1,49 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Counts of latencies in nanoseconds in log-linear buckets, as in an HDR histogram: every value below
+// 2^(SUB_BUCKET_BITS + 1) has a bucket of its own and every power of two above is split into 2^SUB_BUCKET_BITS
+// buckets, so a bucket is never wider than an eighth of the values in it. Latencies above MAX_LATENCY are
+// counted as MAX_LATENCY.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int LATENCY_BITS = 48;
+    static constexpr uint64_t MAX_LATENCY = (uint64_t{ 1 } << LATENCY_BITS) - 1;
+    static constexpr size_t BUCKET_COUNT = (LATENCY_BITS - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+    static size_t GetBucket(uint64_t latency);
+
+    // The largest latency counted in the bucket
+    static uint64_t GetBucketEnd(size_t bucket);
+
+    void Add(std::chrono::nanoseconds latency);
+
+    // Adds count latencies known only by their bucket, their sum and maximum are added with AddTotals
+    void AddToBucket(size_t bucket, uint64_t count);
+
+    void AddTotals(uint64_t sum, uint64_t max);
+
+    void Merge(const LatencyHistogram& other);
+
+    uint64_t GetCount() const;
+
+    std::chrono::nanoseconds GetSum() const;
+
+    std::chrono::nanoseconds GetMax() const;
+
+    std::chrono::nanoseconds GetMean() const;
+
+    // Latency below which the given percent of the latencies stayed, e.g. 99.0 for p99.
+    // Returns the upper end of the bucket the percentile falls into, 0 if the histogram is empty.
+    std::chrono::nanoseconds GetPercentile(double percentile) const;
+
+private:
+    std::array<uint64_t, BUCKET_COUNT> bucket_counts_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
@@ -10,6 +10,8 @@
 using namespace std;
 
 int main() {
+    TestSearchServer();
+
     SearchServer search_server("and with"s);
 
     int id = 0;
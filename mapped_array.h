@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Contiguous array that either owns its elements or borrows them from memory it does not manage,
+// such as a memory-mapped snapshot. Reading never copies; the first GetMutable call copies borrowed
+// elements into owned storage, so a borrowed array can be modified like an owned one.
+template <typename T>
+class MappedArray {
+public:
+    MappedArray() = default;
+
+    explicit MappedArray(std::vector<T> values)
+        : owned_(std::move(values)) {
+    }
+
+    // The memory must outlive the array and all its copies
+    static MappedArray Borrow(const T* data, size_t size) {
+        MappedArray array;
+        array.borrowed_ = data;
+        array.borrowed_size_ = size;
+        array.is_borrowed_ = true;
+        return array;
+    }
+
+    bool IsBorrowed() const {
+        return is_borrowed_;
+    }
+
+    const T* data() const {
+        return is_borrowed_ ? borrowed_ : owned_.data();
+    }
+
+    size_t size() const {
+        return is_borrowed_ ? borrowed_size_ : owned_.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    const T* begin() const {
+        return data();
+    }
+
+    const T* end() const {
+        return data() + size();
+    }
+
+    const T& operator[](size_t index) const {
+        return data()[index];
+    }
+
+    const T& front() const {
+        return data()[0];
+    }
+
+    const T& back() const {
+        return data()[size() - 1];
+    }
+
+    std::vector<T>& GetMutable() {
+        if (is_borrowed_) {
+            owned_.assign(borrowed_, borrowed_ + borrowed_size_);
+            borrowed_ = nullptr;
+            borrowed_size_ = 0;
+            is_borrowed_ = false;
+        }
+        return owned_;
+    }
+
+private:
+    std::vector<T> owned_;
+    const T* borrowed_ = nullptr;
+    size_t borrowed_size_ = 0;
+    bool is_borrowed_ = false;
+};
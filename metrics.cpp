@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <sstream>
+#include <stdexcept>
+
+#include "metrics.h"
+
+using namespace std;
+
+namespace {
+
+// Percentiles every export reports, with their names
+const array<pair<double, const char*>, 4> EXPORTED_PERCENTILES{ {
+    { 50.0, "p50" },
+    { 90.0, "p90" },
+    { 99.0, "p99" },
+    { 99.9, "p999" },
+} };
+
+double ToMicroseconds(chrono::nanoseconds duration) {
+    return chrono::duration<double, micro>(duration).count();
+}
+
+void WriteJsonString(ostream& out, string_view text) {
+    out << '"';
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            static const char HEX_DIGITS[] = "0123456789abcdef";
+            out << "\\u00"sv << HEX_DIGITS[c >> 4] << HEX_DIGITS[c & 0xf];
+        }
+        else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Only the owning thread writes a value, so a plain load and store are enough and cost no locked instruction
+void AddRelaxed(atomic<uint64_t>& value, uint64_t addend) {
+    value.store(value.load(memory_order_relaxed) + addend, memory_order_relaxed);
+}
+
+} // namespace
+
+string MetricsSnapshot::ToText() const {
+    ostringstream out;
+    for (const auto& [name, value] : counters) {
+        out << name << ' ' << value << '\n';
+    }
+    for (const auto& [name, histogram] : histograms) {
+        out << name << " count="sv << histogram.GetCount() << " mean_us="sv << ToMicroseconds(histogram.GetMean());
+        for (const auto& [percentile, percentile_name] : EXPORTED_PERCENTILES) {
+            out << ' ' << percentile_name << "_us="sv << ToMicroseconds(histogram.GetPercentile(percentile));
+        }
+        out << " max_us="sv << ToMicroseconds(histogram.GetMax()) << '\n';
+    }
+    return out.str();
+}
+
+string MetricsSnapshot::ToJson() const {
+    ostringstream out;
+    out << "{\"counters\":{"sv;
+    bool is_first = true;
+    for (const auto& [name, value] : counters) {
+        out << (is_first ? ""sv : ","sv);
+        WriteJsonString(out, name);
+        out << ':' << value;
+        is_first = false;
+    }
+    out << "},\"histograms\":{"sv;
+    is_first = true;
+    for (const auto& [name, histogram] : histograms) {
+        out << (is_first ? ""sv : ","sv);
+        WriteJsonString(out, name);
+        out << ":{\"count\":"sv << histogram.GetCount()
+            << ",\"sum_ns\":"sv << histogram.GetSum().count()
+            << ",\"mean_ns\":"sv << histogram.GetMean().count();
+        for (const auto& [percentile, percentile_name] : EXPORTED_PERCENTILES) {
+            out << ",\""sv << percentile_name << "_ns\":"sv << histogram.GetPercentile(percentile).count();
+        }
+        out << ",\"max_ns\":"sv << histogram.GetMax().count() << '}';
+        is_first = false;
+    }
+    out << "}}"sv;
+    return out.str();
+}
+
+struct MetricsRegistry::ThreadBlock {
+    struct HistogramCells {
+        array<atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT> bucket_counts{};
+        atomic<uint64_t> sum{ 0 };
+        atomic<uint64_t> max{ 0 };
+    };
+
+    array<atomic<uint64_t>, MAX_COUNTER_COUNT> counters{};
+    // Allocated when the thread first records into the histogram, owned by the block
+    array<atomic<HistogramCells*>, MAX_HISTOGRAM_COUNT> histograms{};
+
+    ThreadBlock() = default;
+
+    ThreadBlock(const ThreadBlock&) = delete;
+
+    ThreadBlock& operator=(const ThreadBlock&) = delete;
+
+    ~ThreadBlock() {
+        for (atomic<HistogramCells*>& cells : histograms) {
+            delete cells.load(memory_order_relaxed);
+        }
+    }
+};
+
+// Registers the block of a thread on its first recording and keeps its values when the thread exits
+class MetricsRegistry::ThreadBlockHolder {
+public:
+    explicit ThreadBlockHolder(MetricsRegistry& registry)
+        : registry_(registry)
+        , block_(make_unique<ThreadBlock>()) {
+        registry_.AddThreadBlock(block_.get());
+    }
+
+    ThreadBlockHolder(const ThreadBlockHolder&) = delete;
+
+    ThreadBlockHolder& operator=(const ThreadBlockHolder&) = delete;
+
+    ~ThreadBlockHolder() {
+        registry_.RemoveThreadBlock(block_.get());
+    }
+
+    ThreadBlock& GetBlock() {
+        return *block_;
+    }
+
+private:
+    MetricsRegistry& registry_;
+    unique_ptr<ThreadBlock> block_;
+};
+
+MetricsRegistry& MetricsRegistry::GetInstance() {
+    static MetricsRegistry* const instance = new MetricsRegistry();
+    return *instance;
+}
+
+MetricsRegistry::MetricsRegistry()
+    : exited_counters_(MAX_COUNTER_COUNT)
+    , exited_histograms_(MAX_HISTOGRAM_COUNT) {
+}
+
+size_t MetricsRegistry::RegisterCounter(string_view name) {
+    lock_guard lock(mutex_);
+    return Register(counter_names_, name, MAX_COUNTER_COUNT);
+}
+
+size_t MetricsRegistry::RegisterHistogram(string_view name) {
+    lock_guard lock(mutex_);
+    return Register(histogram_names_, name, MAX_HISTOGRAM_COUNT);
+}
+
+void MetricsRegistry::AddToCounter(size_t counter_id, uint64_t value) {
+    AddRelaxed(GetThreadBlock().counters[counter_id], value);
+}
+
+void MetricsRegistry::RecordLatency(size_t histogram_id, chrono::nanoseconds latency) {
+    atomic<ThreadBlock::HistogramCells*>& cells_pointer = GetThreadBlock().histograms[histogram_id];
+    ThreadBlock::HistogramCells* cells = cells_pointer.load(memory_order_relaxed);
+    if (!cells) {
+        cells = new ThreadBlock::HistogramCells();
+        // Publishes the zeroed cells to GetSnapshot
+        cells_pointer.store(cells, memory_order_release);
+    }
+    const uint64_t value = min(static_cast<uint64_t>(max<int64_t>(latency.count(), 0)), LatencyHistogram::MAX_LATENCY);
+    AddRelaxed(cells->bucket_counts[LatencyHistogram::GetBucket(value)], 1);
+    AddRelaxed(cells->sum, value);
+    if (value > cells->max.load(memory_order_relaxed)) {
+        cells->max.store(value, memory_order_relaxed);
+    }
+}
+
+MetricsSnapshot MetricsRegistry::GetSnapshot() const {
+    MetricsSnapshot snapshot;
+    lock_guard lock(mutex_);
+    for (size_t counter_id = 0; counter_id < counter_names_.size(); ++counter_id) {
+        uint64_t value = exited_counters_[counter_id];
+        for (const ThreadBlock* block : thread_blocks_) {
+            value += block->counters[counter_id].load(memory_order_relaxed);
+        }
+        snapshot.counters.emplace(counter_names_[counter_id], value);
+    }
+    for (size_t histogram_id = 0; histogram_id < histogram_names_.size(); ++histogram_id) {
+        LatencyHistogram histogram = exited_histograms_[histogram_id];
+        for (const ThreadBlock* block : thread_blocks_) {
+            const ThreadBlock::HistogramCells* cells = block->histograms[histogram_id].load(memory_order_acquire);
+            if (!cells) {
+                continue;
+            }
+            for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+                histogram.AddToBucket(bucket, cells->bucket_counts[bucket].load(memory_order_relaxed));
+            }
+            histogram.AddTotals(cells->sum.load(memory_order_relaxed), cells->max.load(memory_order_relaxed));
+        }
+        snapshot.histograms.emplace(histogram_names_[histogram_id], move(histogram));
+    }
+    return snapshot;
+}
+
+size_t MetricsRegistry::Register(vector<string>& names, string_view name, size_t max_count) {
+    const auto it = find(names.begin(), names.end(), name);
+    if (it != names.end()) {
+        return static_cast<size_t>(it - names.begin());
+    }
+    if (names.size() == max_count) {
+        throw length_error("Too many metrics to register "s + string(name));
+    }
+    names.emplace_back(name);
+    return names.size() - 1;
+}
+
+MetricsRegistry::ThreadBlock& MetricsRegistry::GetThreadBlock() {
+    thread_local ThreadBlockHolder holder(*this);
+    return holder.GetBlock();
+}
+
+void MetricsRegistry::AddThreadBlock(ThreadBlock* block) {
+    lock_guard lock(mutex_);
+    thread_blocks_.push_back(block);
+}
+
+void MetricsRegistry::RemoveThreadBlock(ThreadBlock* block) {
+    lock_guard lock(mutex_);
+    for (size_t counter_id = 0; counter_id < MAX_COUNTER_COUNT; ++counter_id) {
+        exited_counters_[counter_id] += block->counters[counter_id].load(memory_order_relaxed);
+    }
+    for (size_t histogram_id = 0; histogram_id < MAX_HISTOGRAM_COUNT; ++histogram_id) {
+        const ThreadBlock::HistogramCells* cells = block->histograms[histogram_id].load(memory_order_relaxed);
+        if (!cells) {
+            continue;
+        }
+        for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+            exited_histograms_[histogram_id].AddToBucket(bucket, cells->bucket_counts[bucket].load(memory_order_relaxed));
+        }
+        exited_histograms_[histogram_id].AddTotals(cells->sum.load(memory_order_relaxed), cells->max.load(memory_order_relaxed));
+    }
+    thread_blocks_.erase(find(thread_blocks_.begin(), thread_blocks_.end(), block));
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "latency_histogram.h"
+
+// Instrumentation of the hot paths with named counters and latency histograms.
+// The METRICS_* macros record only when the build defines SEARCH_METRICS; otherwise they expand to nothing
+// and their arguments are not evaluated, so instrumented code costs nothing in builds without metrics.
+//
+// Every thread records into blocks of its own with plain relaxed stores, nothing is shared between threads
+// on the recording path. GetSnapshot sums the blocks of all threads without stopping them, values of
+// threads that have exited are kept.
+
+#define METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define METRICS_CONCAT(X, Y) METRICS_CONCAT_INTERNAL(X, Y)
+
+#ifdef SEARCH_METRICS
+// Adds value to the counter; the name is looked up once per call site
+#define METRICS_COUNT(name, value) \
+    do { \
+        static const size_t metrics_counter_id = MetricsRegistry::GetInstance().RegisterCounter(name); \
+        MetricsRegistry::GetInstance().AddToCounter(metrics_counter_id, value); \
+    } while (false)
+// Records the time until the end of the enclosing scope into the histogram
+#define METRICS_TIMER(name) \
+    static const size_t METRICS_CONCAT(metricsHistogramId, __LINE__) = MetricsRegistry::GetInstance().RegisterHistogram(name); \
+    const ScopedLatencyTimer METRICS_CONCAT(metricsTimer, __LINE__)(METRICS_CONCAT(metricsHistogramId, __LINE__))
+#else
+#define METRICS_COUNT(name, value) \
+    do { \
+    } while (false)
+#define METRICS_TIMER(name)
+#endif
+
+struct MetricsSnapshot {
+    std::map<std::string, uint64_t> counters;
+    std::map<std::string, LatencyHistogram> histograms;
+
+    // One line per metric, histograms with their count, mean, p50, p90, p99, p99.9 and maximum in microseconds
+    std::string ToText() const;
+
+    // {"counters": {name: value}, "histograms": {name: {"count", "sum_ns", "mean_ns", "p50_ns", ..., "max_ns"}}}
+    std::string ToJson() const;
+};
+
+class MetricsRegistry {
+public:
+    static constexpr size_t MAX_COUNTER_COUNT = 64;
+    static constexpr size_t MAX_HISTOGRAM_COUNT = 64;
+
+    // Process-wide registry used by the macros. It is never destroyed, so threads may record until they exit.
+    static MetricsRegistry& GetInstance();
+
+    MetricsRegistry(const MetricsRegistry&) = delete;
+
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    // Return the id of the metric with this name, registering it on first use.
+    // Throw std::length_error once all MAX_COUNTER_COUNT or MAX_HISTOGRAM_COUNT ids are taken.
+    size_t RegisterCounter(std::string_view name);
+
+    size_t RegisterHistogram(std::string_view name);
+
+    void AddToCounter(size_t counter_id, uint64_t value);
+
+    void RecordLatency(size_t histogram_id, std::chrono::nanoseconds latency);
+
+    MetricsSnapshot GetSnapshot() const;
+
+private:
+    struct ThreadBlock;
+    class ThreadBlockHolder;
+
+    // Guards the names, the list of thread blocks and the values of exited threads, never taken while recording
+    mutable std::mutex mutex_;
+    std::vector<std::string> counter_names_;
+    std::vector<std::string> histogram_names_;
+    std::vector<ThreadBlock*> thread_blocks_;
+    std::vector<uint64_t> exited_counters_;
+    std::vector<LatencyHistogram> exited_histograms_;
+
+    MetricsRegistry();
+
+    static size_t Register(std::vector<std::string>& names, std::string_view name, size_t max_count);
+
+    ThreadBlock& GetThreadBlock();
+
+    void AddThreadBlock(ThreadBlock* block);
+
+    // Keeps the values of the block of an exiting thread
+    void RemoveThreadBlock(ThreadBlock* block);
+};
+
+// Records its lifetime into a histogram of the process-wide registry
+class ScopedLatencyTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ScopedLatencyTimer(size_t histogram_id)
+        : histogram_id_(histogram_id) {
+    }
+
+    ScopedLatencyTimer(const ScopedLatencyTimer&) = delete;
+
+    ScopedLatencyTimer& operator=(const ScopedLatencyTimer&) = delete;
+
+    ~ScopedLatencyTimer() {
+        MetricsRegistry::GetInstance().RecordLatency(histogram_id_, Clock::now() - start_time_);
+    }
+
+private:
+    const size_t histogram_id_;
+    const Clock::time_point start_time_ = Clock::now();
+};
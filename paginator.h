@@ -1,6 +1,11 @@
 #pragma once
 #include <iostream>
 #include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 template <typename Iterator>
 class IteratorRange {
@@ -64,4 +69,78 @@ public:
 
 private:
     std::vector<IteratorRange<Iterator>> pages_;
-};
\ No newline at end of file
+};
+
+// Pages of a list that is computed a page at a time: next_page() returns the following page as a container,
+// and an empty page ends the list. A page is only computed when the iteration reaches it, so a reader that
+// stops early never pays for the pages behind it. The pages can be iterated once.
+template <typename NextPage>
+class LazyPaginator {
+public:
+    using Page = std::decay_t<std::invoke_result_t<NextPage&>>;
+
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Page;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Page*;
+        using reference = const Page&;
+
+        reference operator*() const {
+            return paginator_->page_;
+        }
+
+        pointer operator->() const {
+            return &paginator_->page_;
+        }
+
+        Iterator& operator++() {
+            paginator_->FetchPage();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return IsEnd() == other.IsEnd();
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend LazyPaginator;
+
+        explicit Iterator(LazyPaginator* paginator)
+            : paginator_(paginator) {
+        }
+
+        bool IsEnd() const {
+            return paginator_ == nullptr || paginator_->page_.empty();
+        }
+
+        LazyPaginator* paginator_;
+    };
+
+    explicit LazyPaginator(NextPage next_page)
+        : next_page_(std::move(next_page)) {
+    }
+
+    // Computes the first page
+    Iterator begin() {
+        FetchPage();
+        return Iterator(this);
+    }
+
+    Iterator end() {
+        return Iterator(nullptr);
+    }
+
+private:
+    NextPage next_page_;
+    Page page_;
+
+    void FetchPage() {
+        page_ = next_page_();
+    }
+};
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "posting_list.h"
+
+using namespace std;
+
+void PostingList::Add(DocumentOrdinal document_ordinal, uint32_t term_count, double term_freq) {
+    tail_.GetMutable().push_back({ document_ordinal, term_count });
+    max_term_freq_ = max(max_term_freq_, term_freq);
+    if (tail_.size() == BLOCK_SIZE) {
+        SealTail();
+    }
+}
+
+void PostingList::Remove(DocumentOrdinal document_ordinal) {
+    const auto tail_it = lower_bound(tail_.begin(), tail_.end(), document_ordinal, [](const Posting& posting, DocumentOrdinal ordinal) {
+        return posting.document_ordinal < ordinal;
+        });
+    if (tail_it != tail_.end() && tail_it->document_ordinal == document_ordinal) {
+        const auto position = tail_it - tail_.begin();
+        vector<Posting>& tail = tail_.GetMutable();
+        tail.erase(tail.begin() + position);
+        return;
+    }
+    if (!Contains(document_ordinal)) {
+        return;
+    }
+    vector<DocumentOrdinal>& removed = removed_.GetMutable();
+    removed.insert(lower_bound(removed.begin(), removed.end(), document_ordinal), document_ordinal);
+    if (removed_.size() * 2 > blocks_.size() * BLOCK_SIZE) {
+        Compact();
+    }
+}
+
+bool PostingList::Contains(DocumentOrdinal document_ordinal) const {
+    if (!tail_.empty() && tail_.front().document_ordinal <= document_ordinal) {
+        return binary_search(tail_.begin(), tail_.end(), Posting{ document_ordinal, 0 }, [](const Posting& lhs, const Posting& rhs) {
+            return lhs.document_ordinal < rhs.document_ordinal;
+            });
+    }
+    const size_t block_index = FindBlock(document_ordinal);
+    if (block_index == blocks_.size() || blocks_[block_index].first_ordinal > document_ordinal) {
+        return false;
+    }
+    if (binary_search(removed_.begin(), removed_.end(), document_ordinal)) {
+        return false;
+    }
+    DecodedBlock block;
+    DecodeBlock(block_index, block);
+    return binary_search(block.ordinals.begin(), block.ordinals.begin() + block.size, document_ordinal);
+}
+
+size_t PostingList::size() const {
+    return blocks_.size() * BLOCK_SIZE - removed_.size() + tail_.size();
+}
+
+bool PostingList::empty() const {
+    return size() == 0;
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    return packed_.size() * sizeof(uint32_t)
+        + blocks_.size() * sizeof(BlockInfo)
+        + tail_.size() * sizeof(Posting)
+        + removed_.size() * sizeof(DocumentOrdinal);
+}
+
+void PostingList::Save(SnapshotWriter& writer) const {
+    writer.WriteValue(max_term_freq_);
+    writer.WriteArray(packed_);
+    writer.WriteArray(blocks_);
+    writer.WriteArray(tail_);
+    writer.WriteArray(removed_);
+}
+
+PostingList PostingList::Load(SnapshotReader& reader) {
+    PostingList postings;
+    postings.max_term_freq_ = reader.ReadValue<double>();
+    postings.packed_ = reader.ReadArray<uint32_t>();
+    postings.blocks_ = reader.ReadArray<BlockInfo>();
+    postings.tail_ = reader.ReadArray<Posting>();
+    postings.removed_ = reader.ReadArray<DocumentOrdinal>();
+    // A full tail is sealed into a block, and blocks are decoded into arrays of BLOCK_SIZE postings
+    if (postings.tail_.size() >= BLOCK_SIZE) {
+        throw runtime_error("Snapshot is corrupted");
+    }
+    return postings;
+}
+
+bool PostingList::HasOrdinalsBelow(size_t document_count) const {
+    const bool are_blocks_below = blocks_.empty() || blocks_.back().last_ordinal < document_count;
+    const bool is_tail_below = tail_.empty() || tail_.back().document_ordinal < document_count;
+    return are_blocks_below && is_tail_below;
+}
+
+void PostingList::SealTail() {
+    array<uint32_t, BLOCK_SIZE> deltas;
+    array<uint32_t, BLOCK_SIZE> term_counts;
+    const DocumentOrdinal first_ordinal = tail_.front().document_ordinal;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        deltas[i] = tail_[i].document_ordinal - (i == 0 ? first_ordinal : tail_[i - 1].document_ordinal);
+        term_counts[i] = tail_[i].term_count;
+    }
+    const uint32_t delta_bit_width = GetRequiredBitWidth(deltas.data());
+    const uint32_t term_count_bit_width = GetRequiredBitWidth(term_counts.data());
+
+    vector<uint32_t>& packed = packed_.GetMutable();
+    const size_t offset = packed.size();
+    packed.resize(offset + 1 + GetPackedWordCount(delta_bit_width) + GetPackedWordCount(term_count_bit_width));
+    packed[offset] = delta_bit_width | (term_count_bit_width << 8);
+    PackBlock(deltas.data(), delta_bit_width, packed.data() + offset + 1);
+    PackBlock(term_counts.data(), term_count_bit_width, packed.data() + offset + 1 + GetPackedWordCount(delta_bit_width));
+
+    blocks_.GetMutable().push_back({ first_ordinal, tail_.back().document_ordinal, static_cast<uint32_t>(offset) });
+    tail_.GetMutable().clear();
+}
+
+size_t PostingList::FindBlock(DocumentOrdinal document_ordinal, size_t first_block) const {
+    return static_cast<size_t>(lower_bound(blocks_.begin() + first_block, blocks_.end(), document_ordinal, [](const BlockInfo& block, DocumentOrdinal ordinal) {
+        return block.last_ordinal < ordinal;
+        }) - blocks_.begin());
+}
+
+void PostingList::DecodeBlock(size_t block_index, DecodedBlock& block) const {
+    if (block_index == blocks_.size()) {
+        for (size_t i = 0; i < tail_.size(); ++i) {
+            // Ascending up to the last one, which HasOrdinalsBelow bounds for a loaded list
+            if (i > 0 && tail_[i].document_ordinal <= tail_[i - 1].document_ordinal) {
+                throw runtime_error("Posting list tail is corrupted");
+            }
+            block.ordinals[i] = tail_[i].document_ordinal;
+            block.term_counts[i] = tail_[i].term_count;
+        }
+        block.size = tail_.size();
+        return;
+    }
+    // Blocks of a loaded list are checked here rather than on loading, a few comparisons per decoded block
+    const BlockInfo& info = blocks_[block_index];
+    if (info.offset >= packed_.size() || info.last_ordinal > blocks_.back().last_ordinal) {
+        throw runtime_error("Posting list block is corrupted");
+    }
+    const uint32_t* packed = packed_.data() + info.offset;
+    const uint32_t delta_bit_width = packed[0] & 0xFF;
+    const uint32_t term_count_bit_width = packed[0] >> 8;
+    if (delta_bit_width > 32 || term_count_bit_width > 32
+        || GetPackedWordCount(delta_bit_width) + GetPackedWordCount(term_count_bit_width) > packed_.size() - info.offset - 1) {
+        throw runtime_error("Posting list block is corrupted");
+    }
+    UnpackBlock(packed + 1, delta_bit_width, block.ordinals.data());
+    UnpackBlock(packed + 1 + GetPackedWordCount(delta_bit_width), term_count_bit_width, block.term_counts.data());
+    // Summed without wrapping, so the ordinals only grow and a block ending at its skip pointer stays inside it
+    uint64_t document_ordinal = info.first_ordinal;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        document_ordinal += block.ordinals[i];
+        block.ordinals[i] = static_cast<DocumentOrdinal>(document_ordinal);
+    }
+    if (document_ordinal != info.last_ordinal) {
+        throw runtime_error("Posting list block is corrupted");
+    }
+    block.size = BLOCK_SIZE;
+}
+
+void PostingList::Compact() {
+    vector<Posting> live_postings;
+    live_postings.reserve(size());
+    ForEach([&live_postings](DocumentOrdinal document_ordinal, uint32_t term_count) {
+        live_postings.push_back({ document_ordinal, term_count });
+        });
+
+    packed_ = {};
+    blocks_ = {};
+    tail_ = {};
+    removed_ = {};
+    for (const Posting& posting : live_postings) {
+        tail_.GetMutable().push_back(posting);
+        if (tail_.size() == BLOCK_SIZE) {
+            SealTail();
+        }
+    }
+}
+
+PostingList::Cursor::Cursor(const PostingList& postings)
+    : postings_(&postings) {
+    LoadBlock(0);
+    SkipRemoved();
+}
+
+void PostingList::Cursor::Next() {
+    ++position_;
+    if (position_ == block_.size) {
+        LoadBlock(block_index_ + 1);
+    }
+    SkipRemoved();
+}
+
+void PostingList::Cursor::SkipTo(DocumentOrdinal target) {
+    if (is_end_ || GetOrdinal() >= target) {
+        return;
+    }
+    if (block_.ordinals[block_.size - 1] < target) {
+        // The tail has no skip pointer, FindBlock returns blocks_.size() for it
+        LoadBlock(postings_->FindBlock(target, min(block_index_ + 1, postings_->blocks_.size())));
+        if (is_end_) {
+            return;
+        }
+    }
+    position_ = static_cast<size_t>(lower_bound(block_.ordinals.begin() + position_, block_.ordinals.begin() + block_.size, target) - block_.ordinals.begin());
+    if (position_ == block_.size) {
+        LoadBlock(block_index_ + 1);
+    }
+    SkipRemoved();
+}
+
+void PostingList::Cursor::LoadBlock(size_t block_index) {
+    block_index_ = block_index;
+    position_ = 0;
+    if (block_index_ > postings_->blocks_.size()) {
+        is_end_ = true;
+        return;
+    }
+    postings_->DecodeBlock(block_index_, block_);
+    is_end_ = block_.size == 0;
+}
+
+void PostingList::Cursor::SkipRemoved() {
+    const auto& removed = postings_->removed_;
+    while (!is_end_) {
+        const DocumentOrdinal document_ordinal = GetOrdinal();
+        while (removed_position_ < removed.size() && removed[removed_position_] < document_ordinal) {
+            ++removed_position_;
+        }
+        if (removed_position_ == removed.size() || removed[removed_position_] != document_ordinal) {
+            return;
+        }
+        ++position_;
+        if (position_ == block_.size) {
+            LoadBlock(block_index_ + 1);
+        }
+    }
+}
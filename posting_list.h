@@ -0,0 +1,174 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "bit_packing.h"
+#include "mapped_array.h"
+#include "snapshot.h"
+
+// Dense number of a document inside one server, assigned in the order documents are added.
+// The maximum value is never assigned, it serves as the open end of ordinal ranges.
+using DocumentOrdinal = uint32_t;
+
+// Postings of one term sorted by document ordinal.
+// Every full block of 128 postings is compressed: ordinals are delta coded from the first ordinal of the block
+// and bit packed, term counts are bit packed next to them. The first and last ordinal of every block are kept
+// uncompressed as skip pointers. The postings of the last, incomplete block stay uncompressed.
+// Removal of a compressed posting only records its ordinal; the list is re-encoded once half of it is removed.
+// A list loaded from a snapshot reads its arrays in place and copies them only when it is modified.
+class PostingList {
+public:
+    struct Posting {
+        DocumentOrdinal document_ordinal;
+        uint32_t term_count;
+    };
+
+    // Ordinals must be added in ascending order. term_freq only feeds GetMaxTermFreq.
+    void Add(DocumentOrdinal document_ordinal, uint32_t term_count, double term_freq);
+
+    void Remove(DocumentOrdinal document_ordinal);
+
+    bool Contains(DocumentOrdinal document_ordinal) const;
+
+    // Number of live postings, removed ones are not counted
+    size_t size() const;
+
+    bool empty() const;
+
+    // Calls func(ordinal, term_count) for every live posting
+    template <typename Func>
+    void ForEach(Func func) const;
+
+    // Visits only postings with first_ordinal <= ordinal < last_ordinal
+    template <typename Func>
+    void ForEachInRange(DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal, Func func) const;
+
+    // Upper bound of the term frequency over live postings, removals do not lower it
+    double GetMaxTermFreq() const;
+
+    // Bytes taken by the postings themselves, without the vector headers
+    size_t GetMemoryUsage() const;
+
+    void Save(SnapshotWriter& writer) const;
+
+    // Uses the arrays in place and only checks their sizes, so loading does not depend on the list length.
+    // The blocks and the tail are checked when they are decoded, which throws std::runtime_error
+    // for a block that does not fit the packed words or ordinals that are out of order.
+    static PostingList Load(SnapshotReader& reader);
+
+    // Whether the last ordinal of the blocks and of the tail is below document_count. Decoding checks
+    // every block against its skip pointers and the last block, so this bounds every ordinal of a loaded list.
+    bool HasOrdinalsBelow(size_t document_count) const;
+
+private:
+    static constexpr size_t BLOCK_SIZE = BIT_PACKING_BLOCK_SIZE;
+
+    struct BlockInfo {
+        DocumentOrdinal first_ordinal;
+        DocumentOrdinal last_ordinal;
+        // Position of the block in packed_: a header word with both bit widths, then the ordinal deltas, then the term counts
+        uint32_t offset;
+    };
+
+    struct DecodedBlock {
+        std::array<DocumentOrdinal, BLOCK_SIZE> ordinals;
+        std::array<uint32_t, BLOCK_SIZE> term_counts;
+        size_t size = 0;
+    };
+
+    MappedArray<uint32_t> packed_;
+    MappedArray<BlockInfo> blocks_;
+    MappedArray<Posting> tail_;
+    // Sorted ordinals of removed postings that are still encoded in blocks_
+    MappedArray<DocumentOrdinal> removed_;
+    double max_term_freq_ = 0.0;
+
+    void SealTail();
+
+    // Index of the first block that may contain document_ordinal or a greater one
+    size_t FindBlock(DocumentOrdinal document_ordinal, size_t first_block = 0) const;
+
+    // Block index blocks_.size() stands for the tail
+    void DecodeBlock(size_t block_index, DecodedBlock& block) const;
+
+    void Compact();
+
+public:
+    // Forward-only iterator over live postings for document-at-a-time evaluation
+    class Cursor {
+    public:
+        explicit Cursor(const PostingList& postings);
+
+        bool IsEnd() const {
+            return is_end_;
+        }
+
+        DocumentOrdinal GetOrdinal() const {
+            return block_.ordinals[position_];
+        }
+
+        uint32_t GetTermCount() const {
+            return block_.term_counts[position_];
+        }
+
+        void Next();
+
+        // Moves to the first live posting with ordinal >= target, jumping over whole blocks by their skip pointers
+        void SkipTo(DocumentOrdinal target);
+
+    private:
+        const PostingList* postings_;
+        DecodedBlock block_;
+        size_t block_index_ = 0;
+        size_t position_ = 0;
+        size_t removed_position_ = 0;
+        bool is_end_ = false;
+
+        void LoadBlock(size_t block_index);
+
+        void SkipRemoved();
+    };
+};
+
+template <typename Func>
+void PostingList::ForEach(Func func) const {
+    ForEachInRange(0, std::numeric_limits<DocumentOrdinal>::max(), func);
+}
+
+template <typename Func>
+void PostingList::ForEachInRange(DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal, Func func) const {
+    auto removed_it = std::lower_bound(removed_.begin(), removed_.end(), first_ordinal);
+    DecodedBlock block;
+    for (size_t block_index = FindBlock(first_ordinal); block_index < blocks_.size(); ++block_index) {
+        if (blocks_[block_index].first_ordinal >= last_ordinal) {
+            return;
+        }
+        DecodeBlock(block_index, block);
+        for (size_t i = 0; i < block.size; ++i) {
+            const DocumentOrdinal document_ordinal = block.ordinals[i];
+            if (document_ordinal < first_ordinal) {
+                continue;
+            }
+            if (document_ordinal >= last_ordinal) {
+                return;
+            }
+            while (removed_it != removed_.end() && *removed_it < document_ordinal) {
+                ++removed_it;
+            }
+            if (removed_it != removed_.end() && *removed_it == document_ordinal) {
+                continue;
+            }
+            func(document_ordinal, block.term_counts[i]);
+        }
+    }
+    auto it = std::lower_bound(tail_.begin(), tail_.end(), first_ordinal, [](const Posting& posting, DocumentOrdinal ordinal) {
+        return posting.document_ordinal < ordinal;
+        });
+    for (; it != tail_.end() && it->document_ordinal < last_ordinal; ++it) {
+        func(it->document_ordinal, it->term_count);
+    }
+}
@@ -1,6 +1,6 @@
 #pragma once
 #include <vector>
-#include <list>
+#include <string>
 
 #include "document.h"
 #include "search_server.h"
@@ -9,6 +9,7 @@ std::vector<std::vector<Document>> ProcessQueries(
 	const SearchServer& search_server, 
 	const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(
+// Results of all queries one after another, offsets tell where the results of every query start
+BatchSearchResult ProcessQueriesJoined(
 	const SearchServer& search_server,
 	const std::vector<std::string>& queries);
\ No newline at end of file
@@ -0,0 +1,522 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include "process_queries.h"
+#include "query_daemon.h"
+#include "query_protocol.h"
+
+#ifdef __linux__
+#define QUERY_DAEMON_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+struct QueryDaemon::Connection {
+    int fd = -1;
+    string input;
+    string output;
+    // Bytes at the front of output already written to the socket
+    size_t written_size = 0;
+    // Requests of this connection in batches that are not delivered yet
+    size_t pending_requests = 0;
+    // The client has shut down its side, the connection is closed once its responses are written
+    bool is_read_closed = false;
+    // Parsing stopped at a complete frame while a batch was blocked, input is parsed again once it is queued
+    bool has_unparsed_requests = false;
+};
+
+struct QueryDaemon::Batch {
+    vector<uint64_t> connection_ids;
+    vector<uint64_t> request_ids;
+    vector<string> queries;
+    // Response frame of every query, filled by the evaluating thread
+    vector<string> responses;
+};
+
+#ifdef QUERY_DAEMON_EPOLL
+
+namespace {
+
+// Event ids of the descriptors other than connections
+const uint64_t LISTEN_EVENT_ID = 0;
+const uint64_t WAKE_EVENT_ID = 1;
+const uint64_t TIMER_EVENT_ID = 2;
+const uint64_t FIRST_CONNECTION_ID = 3;
+
+const size_t MAX_EPOLL_EVENTS = 64;
+const size_t READ_BUFFER_SIZE = 64 * 1024;
+// A connection is not read again in one round after this many bytes, so a busy client cannot starve the others
+const size_t MAX_READ_PER_ROUND = 256 * 1024;
+// Requests are not read from a client that lets this many bytes of responses pile up
+const size_t MAX_OUTPUT_BACKLOG = 4 * 1024 * 1024;
+
+runtime_error SystemError(const string& what) {
+    return runtime_error(what + ": "s + strerror(errno));
+}
+
+void AddEvents(int epoll_fd, int fd, uint32_t events, uint64_t event_id) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = event_id;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        throw SystemError("Cannot watch a descriptor"s);
+    }
+}
+
+void SetTimer(int timer_fd, chrono::microseconds delay) {
+    itimerspec timer{};
+    timer.it_value.tv_sec = static_cast<time_t>(delay.count() / 1000000);
+    timer.it_value.tv_nsec = static_cast<long>(delay.count() % 1000000 * 1000);
+    timerfd_settime(timer_fd, 0, &timer, nullptr);
+}
+
+// Reads the counter of an eventfd or a timerfd, 0 if it has not been signaled
+uint64_t ReadCounter(int fd) {
+    uint64_t counter = 0;
+    if (read(fd, &counter, sizeof(counter)) != sizeof(counter)) {
+        return 0;
+    }
+    return counter;
+}
+
+} // namespace
+
+QueryDaemon::QueryDaemon(const SearchServer& search_server, const string& socket_path, QueryDaemonOptions options)
+    : search_server_(search_server)
+    , socket_path_(socket_path)
+    , options_(options)
+    , next_connection_id_(FIRST_CONNECTION_ID)
+    , queued_batches_(options.max_queued_batches) {
+    try {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+            throw runtime_error("Invalid socket path "s + socket_path);
+        }
+        socket_path.copy(address.sun_path, socket_path.size());
+
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            throw SystemError("Cannot create a socket"s);
+        }
+        unlink(socket_path.c_str());
+        if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            throw SystemError("Cannot bind "s + socket_path);
+        }
+        is_bound_ = true;
+        if (listen(listen_fd_, SOMAXCONN) != 0) {
+            throw SystemError("Cannot listen on "s + socket_path);
+        }
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (epoll_fd_ < 0 || wake_fd_ < 0 || timer_fd_ < 0) {
+            throw SystemError("Cannot set up the event loop"s);
+        }
+        AddEvents(epoll_fd_, listen_fd_, EPOLLIN, LISTEN_EVENT_ID);
+        AddEvents(epoll_fd_, wake_fd_, EPOLLIN, WAKE_EVENT_ID);
+        AddEvents(epoll_fd_, timer_fd_, EPOLLIN, TIMER_EVENT_ID);
+    }
+    catch (...) {
+        CloseDescriptors();
+        throw;
+    }
+}
+
+QueryDaemon::~QueryDaemon() {
+    for (const auto& [connection_id, connection] : connections_) {
+        close(connection->fd);
+    }
+    CloseDescriptors();
+}
+
+void QueryDaemon::Run() {
+    thread evaluator([this]() {
+        EvaluateBatches();
+        });
+
+    epoll_event events[MAX_EPOLL_EVENTS];
+    int wait_errno = 0;
+    while (!is_stopping_) {
+        const int event_count = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, -1);
+        if (event_count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            wait_errno = errno;
+            break;
+        }
+        for (int i = 0; i < event_count; ++i) {
+            const uint64_t event_id = events[i].data.u64;
+            if (event_id == LISTEN_EVENT_ID) {
+                AcceptConnections();
+            }
+            else if (event_id == WAKE_EVENT_ID) {
+                ReadCounter(wake_fd_);
+                DeliverEvaluatedBatches();
+                RetryBlockedBatch();
+            }
+            else if (event_id == TIMER_EVENT_ID) {
+                // The timer may have been rearmed for a newer batch after this event was reported
+                if (ReadCounter(timer_fd_) > 0) {
+                    DispatchOpenBatch();
+                }
+            }
+            else if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                CloseConnection(event_id);
+            }
+            else {
+                if (events[i].events & EPOLLIN) {
+                    ReadRequests(event_id);
+                }
+                if (events[i].events & EPOLLOUT) {
+                    WriteResponses(event_id);
+                }
+            }
+        }
+        if (options_.batch_latency.count() == 0) {
+            DispatchOpenBatch();
+        }
+    }
+
+    queued_batches_.Cancel();
+    evaluator.join();
+    if (wait_errno != 0) {
+        errno = wait_errno;
+        throw SystemError("Event loop failed"s);
+    }
+}
+
+void QueryDaemon::Stop() {
+    is_stopping_ = true;
+    const uint64_t one = 1;
+    [[maybe_unused]] const ssize_t written = write(wake_fd_, &one, sizeof(one));
+}
+
+void QueryDaemon::CloseDescriptors() {
+    for (int* fd : { &listen_fd_, &epoll_fd_, &wake_fd_, &timer_fd_ }) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+    if (is_bound_) {
+        unlink(socket_path_.c_str());
+        is_bound_ = false;
+    }
+}
+
+void QueryDaemon::AcceptConnections() {
+    while (true) {
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN once the backlog is empty; other errors concern only the connection being accepted
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        const uint64_t connection_id = next_connection_id_++;
+        auto connection = make_unique<Connection>();
+        connection->fd = fd;
+        epoll_event event{};
+        if (!blocked_batch_) {
+            event.events = EPOLLIN;
+        }
+        event.data.u64 = connection_id;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            continue;
+        }
+        connections_.emplace(connection_id, move(connection));
+        ++accepted_connections_;
+        ++open_connections_;
+    }
+}
+
+void QueryDaemon::ReadRequests(uint64_t connection_id) {
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+    Connection& connection = *it->second;
+
+    char buffer[READ_BUFFER_SIZE];
+    size_t read_size = 0;
+    while (read_size < MAX_READ_PER_ROUND) {
+        const ssize_t size = read(connection.fd, buffer, sizeof(buffer));
+        if (size > 0) {
+            connection.input.append(buffer, static_cast<size_t>(size));
+            read_size += static_cast<size_t>(size);
+        }
+        else if (size == 0) {
+            connection.is_read_closed = true;
+            break;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        else if (errno != EINTR) {
+            CloseConnection(connection_id);
+            return;
+        }
+    }
+    ParseRequests(connection_id);
+}
+
+void QueryDaemon::ParseRequests(uint64_t connection_id) {
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+    Connection& connection = *it->second;
+
+    string_view unread(connection.input);
+    connection.has_unparsed_requests = false;
+    try {
+        while (true) {
+            if (blocked_batch_) {
+                connection.has_unparsed_requests = !unread.empty();
+                break;
+            }
+            const optional<string_view> payload = TakeFrame(unread);
+            if (!payload) {
+                break;
+            }
+            QueryRequest request = ParseQueryRequest(*payload);
+            if (!open_batch_) {
+                open_batch_ = make_unique<Batch>();
+                if (options_.batch_latency.count() > 0) {
+                    SetTimer(timer_fd_, options_.batch_latency);
+                }
+            }
+            open_batch_->connection_ids.push_back(connection_id);
+            open_batch_->request_ids.push_back(request.request_id);
+            open_batch_->queries.push_back(move(request.query));
+            ++connection.pending_requests;
+            ++request_count_;
+            if (open_batch_->queries.size() >= options_.max_batch_size) {
+                DispatchOpenBatch();
+            }
+        }
+    }
+    catch (const invalid_argument&) {
+        ++protocol_error_count_;
+        CloseConnection(connection_id);
+        return;
+    }
+    connection.input.erase(0, connection.input.size() - unread.size());
+    UpdateConnectionEvents(connection_id, connection);
+    CloseConnectionIfDone(connection_id);
+}
+
+void QueryDaemon::WriteResponses(uint64_t connection_id) {
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+    Connection& connection = *it->second;
+
+    while (connection.written_size < connection.output.size()) {
+        const ssize_t size = send(connection.fd, connection.output.data() + connection.written_size,
+            connection.output.size() - connection.written_size, MSG_NOSIGNAL);
+        if (size >= 0) {
+            connection.written_size += static_cast<size_t>(size);
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        else if (errno != EINTR) {
+            CloseConnection(connection_id);
+            return;
+        }
+    }
+    // The written part is dropped once it is at least half of the buffer, so the buffer does not grow without bound
+    if (connection.written_size * 2 >= connection.output.size()) {
+        connection.output.erase(0, connection.written_size);
+        connection.written_size = 0;
+    }
+    UpdateConnectionEvents(connection_id, connection);
+    CloseConnectionIfDone(connection_id);
+}
+
+void QueryDaemon::UpdateConnectionEvents(uint64_t connection_id, const Connection& connection) {
+    const size_t backlog = connection.output.size() - connection.written_size;
+    epoll_event event{};
+    if (!connection.is_read_closed && !blocked_batch_ && backlog < MAX_OUTPUT_BACKLOG) {
+        event.events |= EPOLLIN;
+    }
+    if (backlog > 0) {
+        event.events |= EPOLLOUT;
+    }
+    event.data.u64 = connection_id;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void QueryDaemon::CloseConnection(uint64_t connection_id) {
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+    // Closing the descriptor also removes it from the epoll set
+    close(it->second->fd);
+    connections_.erase(it);
+    --open_connections_;
+}
+
+void QueryDaemon::CloseConnectionIfDone(uint64_t connection_id) {
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+    const Connection& connection = *it->second;
+    if (connection.is_read_closed && connection.pending_requests == 0 && !connection.has_unparsed_requests
+        && connection.written_size == connection.output.size()) {
+        CloseConnection(connection_id);
+    }
+}
+
+void QueryDaemon::DispatchOpenBatch() {
+    if (!open_batch_) {
+        return;
+    }
+    SetTimer(timer_fd_, chrono::microseconds(0));
+    ++batch_count_;
+    if (queued_batches_.TryPush(open_batch_)) {
+        return;
+    }
+    // The evaluating thread is behind. The loop must not block, it still writes responses and accepts
+    // connections, so it holds the batch and stops reading requests until the evaluator takes it.
+    blocked_batch_ = move(open_batch_);
+    for (const auto& [connection_id, connection] : connections_) {
+        UpdateConnectionEvents(connection_id, *connection);
+    }
+}
+
+void QueryDaemon::RetryBlockedBatch() {
+    if (!blocked_batch_ || !queued_batches_.TryPush(blocked_batch_)) {
+        return;
+    }
+    blocked_batch_.reset();
+    vector<uint64_t> connection_ids;
+    connection_ids.reserve(connections_.size());
+    for (const auto& [connection_id, connection] : connections_) {
+        connection_ids.push_back(connection_id);
+    }
+    // Requests buffered while reading was stopped get no new read event, so they are parsed here.
+    // Parsing may block the next batch and close connections, so the ids are looked up one by one.
+    for (const uint64_t connection_id : connection_ids) {
+        const auto it = connections_.find(connection_id);
+        if (it == connections_.end()) {
+            continue;
+        }
+        if (it->second->has_unparsed_requests && !blocked_batch_) {
+            ParseRequests(connection_id);
+        }
+        else {
+            UpdateConnectionEvents(connection_id, *it->second);
+            CloseConnectionIfDone(connection_id);
+        }
+    }
+}
+
+void QueryDaemon::DeliverEvaluatedBatches() {
+    vector<unique_ptr<Batch>> batches;
+    {
+        lock_guard lock(evaluated_batches_mutex_);
+        batches.swap(evaluated_batches_);
+    }
+    vector<uint64_t> connection_ids;
+    for (const unique_ptr<Batch>& batch : batches) {
+        for (size_t i = 0; i < batch->queries.size(); ++i) {
+            const auto it = connections_.find(batch->connection_ids[i]);
+            if (it == connections_.end()) {
+                continue;
+            }
+            it->second->output += batch->responses[i];
+            --it->second->pending_requests;
+            connection_ids.push_back(batch->connection_ids[i]);
+        }
+    }
+    sort(connection_ids.begin(), connection_ids.end());
+    connection_ids.erase(unique(connection_ids.begin(), connection_ids.end()), connection_ids.end());
+    for (const uint64_t connection_id : connection_ids) {
+        WriteResponses(connection_id);
+    }
+}
+
+void QueryDaemon::EvaluateBatches() {
+    while (optional<unique_ptr<Batch>> queued_batch = queued_batches_.Pop()) {
+        Batch& batch = **queued_batch;
+        batch.responses.resize(batch.queries.size());
+        try {
+            const BatchSearchResult result = ProcessQueriesJoined(search_server_, batch.queries);
+            for (size_t i = 0; i < batch.queries.size(); ++i) {
+                AppendResponseFrame(batch.responses[i], batch.request_ids[i],
+                    result.documents.begin() + result.offsets[i], result.documents.begin() + result.offsets[i + 1]);
+            }
+        }
+        catch (const invalid_argument&) {
+            // One invalid query fails the whole batch, the queries are evaluated one by one to answer the others
+            for (size_t i = 0; i < batch.queries.size(); ++i) {
+                batch.responses[i].clear();
+                try {
+                    const vector<Document> documents = search_server_.FindTopDocuments(batch.queries[i]);
+                    AppendResponseFrame(batch.responses[i], batch.request_ids[i], documents.begin(), documents.end());
+                }
+                catch (const invalid_argument& error) {
+                    ++invalid_query_count_;
+                    AppendErrorFrame(batch.responses[i], batch.request_ids[i], QueryResponseStatus::INVALID_QUERY, error.what());
+                }
+            }
+        }
+        {
+            lock_guard lock(evaluated_batches_mutex_);
+            evaluated_batches_.push_back(move(*queued_batch));
+        }
+        const uint64_t one = 1;
+        [[maybe_unused]] const ssize_t written = write(wake_fd_, &one, sizeof(one));
+    }
+}
+
+#else
+
+QueryDaemon::QueryDaemon(const SearchServer& search_server, const string& socket_path, QueryDaemonOptions options)
+    : search_server_(search_server)
+    , socket_path_(socket_path)
+    , options_(options)
+    , next_connection_id_(0)
+    , queued_batches_(options.max_queued_batches) {
+    throw runtime_error("QueryDaemon needs epoll and is only available on Linux"s);
+}
+
+QueryDaemon::~QueryDaemon() = default;
+
+void QueryDaemon::Run() {
+}
+
+void QueryDaemon::Stop() {
+}
+
+#endif
+
+QueryDaemonStats QueryDaemon::GetStats() const {
+    QueryDaemonStats stats;
+    stats.accepted_connections = accepted_connections_;
+    stats.open_connections = open_connections_;
+    stats.request_count = request_count_;
+    stats.batch_count = batch_count_;
+    stats.invalid_query_count = invalid_query_count_;
+    stats.protocol_error_count = protocol_error_count_;
+    return stats;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "search_server.h"
+
+struct QueryDaemonOptions {
+    // A batch is evaluated as soon as it holds this many queries
+    size_t max_batch_size = 64;
+    // or once its first query has waited this long. Zero evaluates whatever has arrived in one round of reads.
+    std::chrono::microseconds batch_latency{ 200 };
+    // Batches waiting for evaluation before the event loop stops reading new requests
+    size_t max_queued_batches = 4;
+};
+
+struct QueryDaemonStats {
+    uint64_t accepted_connections = 0;
+    uint64_t open_connections = 0;
+    uint64_t request_count = 0;
+    uint64_t batch_count = 0;
+    // Queries the server rejected, answered with QueryResponseStatus::INVALID_QUERY
+    uint64_t invalid_query_count = 0;
+    // Connections dropped for malformed frames
+    uint64_t protocol_error_count = 0;
+};
+
+// Serves FindTopDocuments over a Unix domain socket with the framing of query_protocol.h.
+// One thread runs an epoll loop over non-blocking sockets: it accepts connections, reads requests and writes
+// responses. Requests from all connections are collected into micro-batches, which a second thread evaluates
+// with ProcessQueriesJoined, so the latency budget buys one batched pass over the index for many queries.
+// Queries use the default FindTopDocuments arguments: ACTUAL documents, the top MAX_RESULT_DOCUMENT_COUNT.
+// The server must not be modified while the daemon runs. Only available on Linux; elsewhere the constructor throws.
+class QueryDaemon {
+public:
+    // Binds and listens on the socket path, removing a stale socket file left there.
+    // Throws std::runtime_error if the socket cannot be set up.
+    QueryDaemon(const SearchServer& search_server, const std::string& socket_path, QueryDaemonOptions options = {});
+
+    QueryDaemon(const QueryDaemon&) = delete;
+
+    QueryDaemon& operator=(const QueryDaemon&) = delete;
+
+    // Closes the sockets and removes the socket file
+    ~QueryDaemon();
+
+    // Serves requests until Stop is called, at most once per daemon.
+    // Requests still being read or evaluated then are dropped.
+    void Run();
+
+    // May be called from any thread and from a signal handler
+    void Stop();
+
+    QueryDaemonStats GetStats() const;
+
+private:
+    struct Connection;
+    struct Batch;
+
+    const SearchServer& search_server_;
+    const std::string socket_path_;
+    const QueryDaemonOptions options_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    // Wakes the event loop for Stop and for evaluated batches
+    int wake_fd_ = -1;
+    // Fires when the latency budget of the open batch runs out
+    int timer_fd_ = -1;
+    bool is_bound_ = false;
+    std::atomic<bool> is_stopping_{ false };
+
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;
+    uint64_t next_connection_id_;
+    std::unique_ptr<Batch> open_batch_;
+    // A batch the full queue did not take. Requests are not read or parsed until it is queued.
+    std::unique_ptr<Batch> blocked_batch_;
+    BoundedQueue<std::unique_ptr<Batch>> queued_batches_;
+    std::mutex evaluated_batches_mutex_;
+    std::vector<std::unique_ptr<Batch>> evaluated_batches_;
+
+    std::atomic<uint64_t> accepted_connections_{ 0 };
+    std::atomic<uint64_t> open_connections_{ 0 };
+    std::atomic<uint64_t> request_count_{ 0 };
+    std::atomic<uint64_t> batch_count_{ 0 };
+    std::atomic<uint64_t> invalid_query_count_{ 0 };
+    std::atomic<uint64_t> protocol_error_count_{ 0 };
+
+    void CloseDescriptors();
+    void AcceptConnections();
+    void ReadRequests(uint64_t connection_id);
+    void ParseRequests(uint64_t connection_id);
+    void WriteResponses(uint64_t connection_id);
+    void UpdateConnectionEvents(uint64_t connection_id, const Connection& connection);
+    void CloseConnection(uint64_t connection_id);
+    void CloseConnectionIfDone(uint64_t connection_id);
+    void DispatchOpenBatch();
+    void RetryBlockedBatch();
+    void DeliverEvaluatedBatches();
+    void EvaluateBatches();
+};
@@ -0,0 +1,121 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "query_protocol.h"
+
+using namespace std;
+
+namespace {
+
+const size_t FRAME_HEADER_SIZE = sizeof(uint32_t);
+const size_t RESPONSE_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint8_t);
+const size_t DOCUMENT_RECORD_SIZE = sizeof(int32_t) + sizeof(int32_t) + sizeof(uint64_t);
+
+} // namespace
+
+size_t BeginFrame(string& out) {
+    const size_t frame_begin = out.size();
+    out.append(FRAME_HEADER_SIZE, '\0');
+    return frame_begin;
+}
+
+void EndFrame(string& out, size_t frame_begin) {
+    const uint64_t payload_size = out.size() - frame_begin - FRAME_HEADER_SIZE;
+    if (payload_size > MAX_QUERY_FRAME_SIZE) {
+        out.resize(frame_begin);
+        throw invalid_argument("Frame of "s + to_string(payload_size) + " bytes is too large"s);
+    }
+    for (size_t i = 0; i < FRAME_HEADER_SIZE; ++i) {
+        out[frame_begin + i] = static_cast<char>(payload_size >> (8 * i));
+    }
+}
+
+void AppendQueryFrame(string& out, uint64_t request_id, string_view query) {
+    const size_t frame_begin = BeginFrame(out);
+    AppendLittleEndian(out, request_id);
+    out.append(query);
+    EndFrame(out, frame_begin);
+}
+
+void AppendResponseFrame(string& out, uint64_t request_id, vector<Document>::const_iterator first, vector<Document>::const_iterator last) {
+    const size_t frame_begin = BeginFrame(out);
+    AppendLittleEndian(out, request_id);
+    AppendLittleEndian(out, static_cast<uint8_t>(QueryResponseStatus::OK));
+    AppendLittleEndian(out, static_cast<uint32_t>(last - first));
+    for (auto it = first; it != last; ++it) {
+        const Document& document = *it;
+        uint64_t relevance_bits;
+        memcpy(&relevance_bits, &document.relevance, sizeof(relevance_bits));
+        AppendLittleEndian(out, static_cast<uint32_t>(document.id));
+        AppendLittleEndian(out, static_cast<uint32_t>(document.rating));
+        AppendLittleEndian(out, relevance_bits);
+    }
+    EndFrame(out, frame_begin);
+}
+
+void AppendErrorFrame(string& out, uint64_t request_id, QueryResponseStatus status, string_view error) {
+    const size_t frame_begin = BeginFrame(out);
+    AppendLittleEndian(out, request_id);
+    AppendLittleEndian(out, static_cast<uint8_t>(status));
+    out.append(error.substr(0, MAX_QUERY_FRAME_SIZE - RESPONSE_HEADER_SIZE));
+    EndFrame(out, frame_begin);
+}
+
+optional<string_view> TakeFrame(string_view& buffer) {
+    if (buffer.size() < FRAME_HEADER_SIZE) {
+        return nullopt;
+    }
+    const uint32_t payload_size = ReadLittleEndian<uint32_t>(buffer.data());
+    if (payload_size > MAX_QUERY_FRAME_SIZE) {
+        throw invalid_argument("Frame of "s + to_string(payload_size) + " bytes is too large"s);
+    }
+    if (buffer.size() - FRAME_HEADER_SIZE < payload_size) {
+        return nullopt;
+    }
+    const string_view payload = buffer.substr(FRAME_HEADER_SIZE, payload_size);
+    buffer.remove_prefix(FRAME_HEADER_SIZE + payload_size);
+    return payload;
+}
+
+QueryRequest ParseQueryRequest(string_view payload) {
+    if (payload.size() < sizeof(uint64_t)) {
+        throw invalid_argument("Request is too short"s);
+    }
+    QueryRequest request;
+    request.request_id = ReadLittleEndian<uint64_t>(payload.data());
+    request.query = payload.substr(sizeof(uint64_t));
+    return request;
+}
+
+QueryResponse ParseQueryResponse(string_view payload) {
+    if (payload.size() < RESPONSE_HEADER_SIZE) {
+        throw invalid_argument("Response is too short"s);
+    }
+    QueryResponse response;
+    response.request_id = ReadLittleEndian<uint64_t>(payload.data());
+    response.status = static_cast<QueryResponseStatus>(ReadLittleEndian<uint8_t>(payload.data() + sizeof(uint64_t)));
+    payload.remove_prefix(RESPONSE_HEADER_SIZE);
+    if (response.status != QueryResponseStatus::OK) {
+        response.error = payload;
+        return response;
+    }
+    if (payload.size() < sizeof(uint32_t)) {
+        throw invalid_argument("Response is too short"s);
+    }
+    const uint32_t document_count = ReadLittleEndian<uint32_t>(payload.data());
+    payload.remove_prefix(sizeof(uint32_t));
+    if (payload.size() != static_cast<uint64_t>(document_count) * DOCUMENT_RECORD_SIZE) {
+        throw invalid_argument("Response size does not match its document count"s);
+    }
+    response.documents.reserve(document_count);
+    for (const char* record = payload.data(); record != payload.data() + payload.size(); record += DOCUMENT_RECORD_SIZE) {
+        const uint64_t relevance_bits = ReadLittleEndian<uint64_t>(record + 2 * sizeof(int32_t));
+        double relevance;
+        memcpy(&relevance, &relevance_bits, sizeof(relevance));
+        response.documents.emplace_back(
+            static_cast<int32_t>(ReadLittleEndian<uint32_t>(record)),
+            relevance,
+            static_cast<int32_t>(ReadLittleEndian<uint32_t>(record + sizeof(int32_t))));
+    }
+    return response;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+
+// Binary framing spoken by QueryDaemon and its clients. Every message is a frame: a 32-bit payload size
+// followed by the payload. All integers are little-endian, whatever the byte order of the machine.
+//
+// Request payload:  request id (u64), query text (the rest of the payload)
+// Response payload: request id (u64), status (u8), then for OK the document count (u32) and per document
+//                   id (i32), rating (i32) and relevance (IEEE 754 double as u64); otherwise an error message.
+//
+// A connection may send any number of requests without waiting for responses. Responses carry the id of
+// their request and come back in the order the requests were sent.
+
+// Larger frames are a protocol error and the connection is dropped
+const uint32_t MAX_QUERY_FRAME_SIZE = 1u << 20;
+
+struct QueryRequest {
+    uint64_t request_id = 0;
+    std::string query;
+};
+
+enum class QueryResponseStatus : uint8_t {
+    OK = 0,
+    // The server rejected the query text, e.g. a word with control characters or a lone minus
+    INVALID_QUERY = 1,
+};
+
+struct QueryResponse {
+    uint64_t request_id = 0;
+    QueryResponseStatus status = QueryResponseStatus::OK;
+    std::vector<Document> documents;
+    std::string error;
+};
+
+// Building blocks of the frames, also used by the shard protocol of remote_shard.h.
+// BeginFrame reserves the size field of a frame and returns where the frame starts, EndFrame fills it in.
+// EndFrame throws std::invalid_argument and drops the frame if its payload is larger than MAX_QUERY_FRAME_SIZE.
+size_t BeginFrame(std::string& out);
+
+void EndFrame(std::string& out, size_t frame_begin);
+
+template <typename T>
+void AppendLittleEndian(std::string& out, T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (8 * i)));
+    }
+}
+
+template <typename T>
+T ReadLittleEndian(const char* data) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return static_cast<T>(value);
+}
+
+// Append a complete frame to the output buffer
+void AppendQueryFrame(std::string& out, uint64_t request_id, std::string_view query);
+
+void AppendResponseFrame(std::string& out, uint64_t request_id, std::vector<Document>::const_iterator first, std::vector<Document>::const_iterator last);
+
+void AppendErrorFrame(std::string& out, uint64_t request_id, QueryResponseStatus status, std::string_view error);
+
+// Cuts the payload of the first frame off the buffer, returns nothing if the frame is not complete yet.
+// Throws std::invalid_argument if the frame is larger than MAX_QUERY_FRAME_SIZE.
+std::optional<std::string_view> TakeFrame(std::string_view& buffer);
+
+// Throw std::invalid_argument if the payload is malformed
+QueryRequest ParseQueryRequest(std::string_view payload);
+
+QueryResponse ParseQueryResponse(std::string_view payload);
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <functional>
+
+#include "query_result_cache.h"
+
+using namespace std;
+
+QueryResultCache::QueryResultCache(size_t capacity, size_t shard_count)
+    : shard_capacity_((capacity + max<size_t>(shard_count, 1) - 1) / max<size_t>(shard_count, 1))
+    , shards_(max<size_t>(shard_count, 1)) {
+}
+
+optional<vector<Document>> QueryResultCache::Find(const string& key, uint64_t generation) {
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    const auto index_it = shard.index.find(key);
+    if (index_it == shard.index.end()) {
+        misses_.fetch_add(1, memory_order_relaxed);
+        return nullopt;
+    }
+    const auto entry_it = index_it->second;
+    if (entry_it->generation != generation) {
+        shard.index.erase(index_it);
+        shard.entries.erase(entry_it);
+        misses_.fetch_add(1, memory_order_relaxed);
+        return nullopt;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, entry_it);
+    hits_.fetch_add(1, memory_order_relaxed);
+    return entry_it->documents;
+}
+
+void QueryResultCache::Insert(string key, uint64_t generation, vector<Document> documents) {
+    if (shard_capacity_ == 0) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    const auto index_it = shard.index.find(key);
+    if (index_it != shard.index.end()) {
+        // Another thread has computed the same query meanwhile
+        const auto entry_it = index_it->second;
+        entry_it->generation = generation;
+        entry_it->documents = move(documents);
+        shard.entries.splice(shard.entries.begin(), shard.entries, entry_it);
+        return;
+    }
+    if (shard.entries.size() == shard_capacity_) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front({ move(key), generation, move(documents) });
+    // The key of a list node never moves, so the index can refer to it
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+}
+
+QueryResultCache::Stats QueryResultCache::GetStats() const {
+    Stats stats;
+    stats.hits = hits_.load(memory_order_relaxed);
+    stats.misses = misses_.load(memory_order_relaxed);
+    stats.capacity = shard_capacity_ * shards_.size();
+    for (const Shard& shard : shards_) {
+        lock_guard guard(shard.mutex);
+        stats.size += shard.entries.size();
+    }
+    return stats;
+}
+
+void QueryResultCache::Clear() {
+    for (Shard& shard : shards_) {
+        lock_guard guard(shard.mutex);
+        shard.index.clear();
+        shard.entries.clear();
+    }
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(const string& key) {
+    return shards_[hash<string>{}(key) % shards_.size()];
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+
+// Size-bounded concurrent cache of search results with least-recently-used eviction.
+// Keys are split between shards with their own mutex and LRU list; the capacity is shared equally by the shards.
+// Every entry remembers the index generation it was computed for, and a lookup with another generation
+// drops it as stale, so the owner only has to bump its generation when the index changes.
+class QueryResultCache {
+public:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+    static constexpr size_t DEFAULT_SHARD_COUNT = 16;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t size = 0;
+        size_t capacity = 0;
+    };
+
+    explicit QueryResultCache(size_t capacity, size_t shard_count = DEFAULT_SHARD_COUNT);
+
+    QueryResultCache(const QueryResultCache&) = delete;
+
+    QueryResultCache& operator=(const QueryResultCache&) = delete;
+
+    std::optional<std::vector<Document>> Find(const std::string& key, uint64_t generation);
+
+    void Insert(std::string key, uint64_t generation, std::vector<Document> documents);
+
+    Stats GetStats() const;
+
+    void Clear();
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::vector<Document> documents;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        mutable std::mutex mutex;
+        // Most recently used entries first
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    };
+
+    size_t shard_capacity_;
+    std::vector<Shard> shards_;
+    std::atomic<uint64_t> hits_{ 0 };
+    std::atomic<uint64_t> misses_{ 0 };
+
+    Shard& GetShard(const std::string& key);
+};
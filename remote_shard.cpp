@@ -0,0 +1,633 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "query_protocol.h"
+#include "remote_shard.h"
+
+#ifdef __linux__
+#define REMOTE_SHARD_SOCKETS
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const size_t RESPONSE_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint8_t);
+const size_t READ_BUFFER_SIZE = 64 * 1024;
+// Ids of one REMOVE request, larger batches are split so that every frame stays below MAX_QUERY_FRAME_SIZE
+const size_t MAX_REMOVE_REQUEST_SIZE = 64 * 1024;
+
+// Reads the fields of a payload front to back, throws std::runtime_error past its end
+class PayloadReader {
+public:
+    explicit PayloadReader(string_view payload)
+        : payload_(payload) {
+    }
+
+    template <typename T>
+    T Read() {
+        Require(sizeof(T));
+        const T value = ReadLittleEndian<T>(payload_.data());
+        payload_.remove_prefix(sizeof(T));
+        return value;
+    }
+
+    // Reads a u32 count of elements of element_size bytes each and checks that they fit into the payload
+    size_t ReadCount(size_t element_size) {
+        const size_t count = Read<uint32_t>();
+        Require(count * element_size);
+        return count;
+    }
+
+    string_view ReadString(size_t size) {
+        Require(size);
+        const string_view value = payload_.substr(0, size);
+        payload_.remove_prefix(size);
+        return value;
+    }
+
+    string_view ReadRest() {
+        return exchange(payload_, string_view());
+    }
+
+private:
+    string_view payload_;
+
+    void Require(size_t size) const {
+        if (payload_.size() < size) {
+            throw runtime_error("Shard message is too short"s);
+        }
+    }
+};
+
+DocumentStatus ReadDocumentStatus(PayloadReader& reader) {
+    const uint8_t status = reader.Read<uint8_t>();
+    if (status > static_cast<uint8_t>(DocumentStatus::REMOVED)) {
+        throw runtime_error("Shard message has an unknown document status"s);
+    }
+    return static_cast<DocumentStatus>(status);
+}
+
+void AppendStatistics(string& out, const QueryStatistics& statistics) {
+    AppendLittleEndian(out, static_cast<uint32_t>(statistics.document_count));
+    AppendLittleEndian(out, static_cast<uint32_t>(statistics.document_frequencies.size()));
+    for (const size_t document_frequency : statistics.document_frequencies) {
+        AppendLittleEndian(out, static_cast<uint64_t>(document_frequency));
+    }
+}
+
+QueryStatistics ReadStatistics(PayloadReader& reader) {
+    QueryStatistics statistics;
+    statistics.document_count = static_cast<int32_t>(reader.Read<uint32_t>());
+    statistics.document_frequencies.resize(reader.ReadCount(sizeof(uint64_t)));
+    for (size_t& document_frequency : statistics.document_frequencies) {
+        document_frequency = static_cast<size_t>(reader.Read<uint64_t>());
+    }
+    return statistics;
+}
+
+// Records of the documents as in the responses of query_protocol.h
+void AppendDocuments(string& out, const vector<Document>& documents) {
+    AppendLittleEndian(out, static_cast<uint32_t>(documents.size()));
+    for (const Document& document : documents) {
+        uint64_t relevance_bits;
+        memcpy(&relevance_bits, &document.relevance, sizeof(relevance_bits));
+        AppendLittleEndian(out, static_cast<uint32_t>(document.id));
+        AppendLittleEndian(out, static_cast<uint32_t>(document.rating));
+        AppendLittleEndian(out, relevance_bits);
+    }
+}
+
+vector<Document> ReadDocuments(PayloadReader& reader) {
+    vector<Document> documents(reader.ReadCount(sizeof(int32_t) + sizeof(int32_t) + sizeof(uint64_t)));
+    for (Document& document : documents) {
+        document.id = static_cast<int32_t>(reader.Read<uint32_t>());
+        document.rating = static_cast<int32_t>(reader.Read<uint32_t>());
+        const uint64_t relevance_bits = reader.Read<uint64_t>();
+        memcpy(&document.relevance, &relevance_bits, sizeof(document.relevance));
+    }
+    return documents;
+}
+
+} // namespace
+
+#ifdef REMOTE_SHARD_SOCKETS
+
+namespace {
+
+runtime_error SystemError(const string& what) {
+    return runtime_error(what + ": "s + strerror(errno));
+}
+
+sockaddr_un MakeSocketAddress(const string& socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        throw runtime_error("Invalid socket path "s + socket_path);
+    }
+    socket_path.copy(address.sun_path, socket_path.size());
+    return address;
+}
+
+// Returns false if the connection is gone
+bool SendAll(int fd, string_view data) {
+    while (!data.empty()) {
+        const ssize_t size = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(size));
+    }
+    return true;
+}
+
+// Appends what has arrived to the input, returns false once the connection is closed or fails
+bool ReceiveSome(int fd, string& input) {
+    char buffer[READ_BUFFER_SIZE];
+    while (true) {
+        const ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size <= 0) {
+            return false;
+        }
+        input.append(buffer, static_cast<size_t>(size));
+        return true;
+    }
+}
+
+} // namespace
+
+ShardWorker::ShardWorker(SearchServer& search_server, const string& socket_path)
+    : search_server_(search_server)
+    , socket_path_(socket_path) {
+    try {
+        const sockaddr_un address = MakeSocketAddress(socket_path);
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            throw SystemError("Cannot create a socket"s);
+        }
+        unlink(socket_path.c_str());
+        if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            throw SystemError("Cannot bind "s + socket_path);
+        }
+        is_bound_ = true;
+        if (listen(listen_fd_, SOMAXCONN) != 0) {
+            throw SystemError("Cannot listen on "s + socket_path);
+        }
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd_ < 0) {
+            throw SystemError("Cannot set up the worker"s);
+        }
+    }
+    catch (...) {
+        CloseDescriptors();
+        throw;
+    }
+}
+
+ShardWorker::~ShardWorker() {
+    CloseDescriptors();
+}
+
+void ShardWorker::Run() {
+    pollfd events[2] = { { listen_fd_, POLLIN, 0 }, { wake_fd_, POLLIN, 0 } };
+    int poll_errno = 0;
+    while (!is_stopping_) {
+        if (poll(events, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            poll_errno = errno;
+            break;
+        }
+        if (!(events[0].revents & POLLIN)) {
+            continue;
+        }
+        // Connections are served with blocking sockets, accept4 does not pass on the O_NONBLOCK of the listener
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        lock_guard lock(connections_mutex_);
+        connection_fds_.push_back(fd);
+        try {
+            thread([this, fd]() {
+                ServeConnection(fd);
+                }).detach();
+        }
+        catch (const system_error&) {
+            connection_fds_.pop_back();
+            close(fd);
+        }
+    }
+
+    {
+        unique_lock lock(connections_mutex_);
+        for (const int fd : connection_fds_) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        connections_closed_.wait(lock, [this]() {
+            return connection_fds_.empty();
+            });
+    }
+    if (poll_errno != 0) {
+        errno = poll_errno;
+        throw SystemError("Worker loop failed"s);
+    }
+}
+
+void ShardWorker::Stop() {
+    is_stopping_ = true;
+    const uint64_t one = 1;
+    [[maybe_unused]] const ssize_t written = write(wake_fd_, &one, sizeof(one));
+}
+
+void ShardWorker::CloseDescriptors() {
+    for (int* fd : { &listen_fd_, &wake_fd_ }) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+    if (is_bound_) {
+        unlink(socket_path_.c_str());
+        is_bound_ = false;
+    }
+}
+
+void ShardWorker::ServeConnection(int fd) {
+    string input;
+    string output;
+    try {
+        while (ReceiveSome(fd, input)) {
+            string_view unparsed = input;
+            output.clear();
+            while (const optional<string_view> payload = TakeFrame(unparsed)) {
+                AnswerRequest(*payload, output);
+            }
+            input.erase(0, input.size() - unparsed.size());
+            if (!SendAll(fd, output)) {
+                break;
+            }
+        }
+    }
+    catch (const exception&) {
+        // A malformed frame, the connection is dropped
+    }
+    CloseConnection(fd);
+}
+
+void ShardWorker::CloseConnection(int fd) {
+    // Closed under the lock, so Run never shuts down a descriptor that has been reused
+    lock_guard lock(connections_mutex_);
+    close(fd);
+    connection_fds_.erase(find(connection_fds_.begin(), connection_fds_.end(), fd));
+    if (connection_fds_.empty()) {
+        // Notified under the lock, the worker may be destroyed as soon as Run sees no connections
+        connections_closed_.notify_all();
+    }
+}
+
+RemoteShard::RemoteShard(const string& socket_path) {
+    const sockaddr_un address = MakeSocketAddress(socket_path);
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0 || connect(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        const string error = strerror(errno);
+        Disconnect();
+        throw runtime_error("Cannot connect to "s + socket_path + ": "s + error);
+    }
+}
+
+string RemoteShard::Call(ShardRequestKind kind, string_view arguments) const {
+    lock_guard lock(mutex_);
+    if (fd_ < 0) {
+        throw runtime_error("Connection to the shard worker is lost"s);
+    }
+    const uint64_t request_id = next_request_id_++;
+    string request;
+    const size_t frame_begin = BeginFrame(request);
+    AppendLittleEndian(request, request_id);
+    AppendLittleEndian(request, static_cast<uint8_t>(kind));
+    request.append(arguments);
+    EndFrame(request, frame_begin);
+
+    string payload;
+    try {
+        if (!SendAll(fd_, request)) {
+            throw runtime_error("Cannot send to the shard worker"s);
+        }
+        while (true) {
+            string_view buffer = input_;
+            if (const optional<string_view> frame = TakeFrame(buffer)) {
+                payload = *frame;
+                input_.erase(0, input_.size() - buffer.size());
+                break;
+            }
+            if (!ReceiveSome(fd_, input_)) {
+                throw runtime_error("Shard worker closed the connection"s);
+            }
+        }
+        if (payload.size() < RESPONSE_HEADER_SIZE || ReadLittleEndian<uint64_t>(payload.data()) != request_id
+            || ReadLittleEndian<uint8_t>(payload.data() + sizeof(uint64_t)) > static_cast<uint8_t>(ShardResponseStatus::FAILED)) {
+            throw runtime_error("Shard worker sent a malformed response"s);
+        }
+    }
+    catch (const exception& error) {
+        Disconnect();
+        throw runtime_error(error.what());
+    }
+
+    const auto status = static_cast<ShardResponseStatus>(ReadLittleEndian<uint8_t>(payload.data() + sizeof(uint64_t)));
+    payload.erase(0, RESPONSE_HEADER_SIZE);
+    if (status == ShardResponseStatus::INVALID_ARGUMENT) {
+        throw invalid_argument(payload);
+    }
+    if (status == ShardResponseStatus::OUT_OF_RANGE) {
+        throw out_of_range(payload);
+    }
+    if (status == ShardResponseStatus::FAILED) {
+        throw runtime_error(payload);
+    }
+    return payload;
+}
+
+void RemoteShard::Disconnect() const {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+#else
+
+ShardWorker::ShardWorker(SearchServer& search_server, const string& socket_path)
+    : search_server_(search_server)
+    , socket_path_(socket_path) {
+    throw runtime_error("ShardWorker needs Unix domain sockets and is only available on Linux"s);
+}
+
+ShardWorker::~ShardWorker() = default;
+
+void ShardWorker::Run() {
+}
+
+void ShardWorker::Stop() {
+}
+
+RemoteShard::RemoteShard(const string&) {
+    throw runtime_error("RemoteShard needs Unix domain sockets and is only available on Linux"s);
+}
+
+string RemoteShard::Call(ShardRequestKind, string_view) const {
+    throw runtime_error("Connection to the shard worker is lost"s);
+}
+
+void RemoteShard::Disconnect() const {
+}
+
+#endif
+
+void ShardWorker::AnswerRequest(string_view payload, string& output) {
+    PayloadReader reader(payload);
+    const uint64_t request_id = reader.Read<uint64_t>();
+    const uint8_t kind = reader.Read<uint8_t>();
+    string result;
+    ShardResponseStatus status = ShardResponseStatus::OK;
+    try {
+        switch (static_cast<ShardRequestKind>(kind)) {
+        case ShardRequestKind::STATISTICS: {
+            shared_lock lock(server_mutex_);
+            AppendStatistics(result, search_server_.GetQueryStatistics(reader.ReadRest()));
+            break;
+        }
+        case ShardRequestKind::SEARCH: {
+            const DocumentStatus document_status = ReadDocumentStatus(reader);
+            const size_t top_count = static_cast<size_t>(reader.Read<uint64_t>());
+            const QueryStatistics statistics = ReadStatistics(reader);
+            shared_lock lock(server_mutex_);
+            AppendDocuments(result, search_server_.FindTopDocumentsWithStatistics(reader.ReadRest(), statistics,
+                [document_status]([[maybe_unused]] int document_id, DocumentStatus status, [[maybe_unused]] int rating) {
+                    return status == document_status;
+                }, top_count));
+            break;
+        }
+        case ShardRequestKind::MATCH: {
+            const int document_id = static_cast<int32_t>(reader.Read<uint32_t>());
+            shared_lock lock(server_mutex_);
+            const auto [words, document_status] = search_server_.MatchDocument(reader.ReadRest(), document_id);
+            AppendLittleEndian(result, static_cast<uint8_t>(document_status));
+            AppendLittleEndian(result, static_cast<uint32_t>(words.size()));
+            for (const string_view word : words) {
+                AppendLittleEndian(result, static_cast<uint32_t>(word.size()));
+                result.append(word);
+            }
+            break;
+        }
+        case ShardRequestKind::ADD: {
+            const int document_id = static_cast<int32_t>(reader.Read<uint32_t>());
+            const DocumentStatus document_status = ReadDocumentStatus(reader);
+            vector<int> ratings(reader.ReadCount(sizeof(int32_t)));
+            for (int& rating : ratings) {
+                rating = static_cast<int32_t>(reader.Read<uint32_t>());
+            }
+            unique_lock lock(server_mutex_);
+            search_server_.AddDocument(document_id, reader.ReadRest(), document_status, ratings);
+            break;
+        }
+        case ShardRequestKind::REMOVE: {
+            vector<int> document_ids(reader.ReadCount(sizeof(int32_t)));
+            for (int& document_id : document_ids) {
+                document_id = static_cast<int32_t>(reader.Read<uint32_t>());
+            }
+            unique_lock lock(server_mutex_);
+            search_server_.RemoveDocuments(document_ids);
+            break;
+        }
+        case ShardRequestKind::DOCUMENT_COUNT: {
+            shared_lock lock(server_mutex_);
+            AppendLittleEndian(result, static_cast<uint32_t>(search_server_.GetDocumentCount()));
+            break;
+        }
+        default:
+            throw runtime_error("Unknown shard request kind "s + to_string(kind));
+        }
+        if (result.size() > MAX_QUERY_FRAME_SIZE - RESPONSE_HEADER_SIZE) {
+            throw invalid_argument("Shard result of "s + to_string(result.size()) + " bytes is too large"s);
+        }
+    }
+    catch (const invalid_argument& error) {
+        status = ShardResponseStatus::INVALID_ARGUMENT;
+        result = error.what();
+    }
+    catch (const out_of_range& error) {
+        status = ShardResponseStatus::OUT_OF_RANGE;
+        result = error.what();
+    }
+    catch (const exception& error) {
+        status = ShardResponseStatus::FAILED;
+        result = error.what();
+    }
+
+    const size_t frame_begin = BeginFrame(output);
+    AppendLittleEndian(output, request_id);
+    AppendLittleEndian(output, static_cast<uint8_t>(status));
+    output.append(string_view(result).substr(0, MAX_QUERY_FRAME_SIZE - RESPONSE_HEADER_SIZE));
+    EndFrame(output, frame_begin);
+}
+
+RemoteShard::~RemoteShard() {
+    Disconnect();
+}
+
+QueryStatistics RemoteShard::GetQueryStatistics(string_view raw_query) const {
+    const string result = Call(ShardRequestKind::STATISTICS, raw_query);
+    PayloadReader reader(result);
+    return ReadStatistics(reader);
+}
+
+vector<Document> RemoteShard::FindTopDocumentsWithStatistics(string_view raw_query, const QueryStatistics& statistics,
+    DocumentStatus status, size_t top_count) const {
+    string arguments;
+    AppendLittleEndian(arguments, static_cast<uint8_t>(status));
+    AppendLittleEndian(arguments, static_cast<uint64_t>(top_count));
+    AppendStatistics(arguments, statistics);
+    arguments.append(raw_query);
+    const string result = Call(ShardRequestKind::SEARCH, arguments);
+    PayloadReader reader(result);
+    return ReadDocuments(reader);
+}
+
+RemoteShard::MatchDocumentResult RemoteShard::MatchDocument(string_view raw_query, int document_id) const {
+    string arguments;
+    AppendLittleEndian(arguments, static_cast<uint32_t>(document_id));
+    arguments.append(raw_query);
+    const string result = Call(ShardRequestKind::MATCH, arguments);
+    PayloadReader reader(result);
+    const DocumentStatus status = ReadDocumentStatus(reader);
+    vector<string> words(reader.ReadCount(sizeof(uint32_t)));
+    for (string& word : words) {
+        word = reader.ReadString(reader.Read<uint32_t>());
+    }
+    return { move(words), status };
+}
+
+void RemoteShard::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    string arguments;
+    AppendLittleEndian(arguments, static_cast<uint32_t>(document_id));
+    AppendLittleEndian(arguments, static_cast<uint8_t>(status));
+    AppendLittleEndian(arguments, static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        AppendLittleEndian(arguments, static_cast<uint32_t>(rating));
+    }
+    arguments.append(document);
+    Call(ShardRequestKind::ADD, arguments);
+}
+
+void RemoteShard::RemoveDocuments(const vector<int>& document_ids) {
+    for (size_t first = 0; first < document_ids.size(); first += MAX_REMOVE_REQUEST_SIZE) {
+        const size_t last = min(document_ids.size(), first + MAX_REMOVE_REQUEST_SIZE);
+        string arguments;
+        AppendLittleEndian(arguments, static_cast<uint32_t>(last - first));
+        for (size_t i = first; i < last; ++i) {
+            AppendLittleEndian(arguments, static_cast<uint32_t>(document_ids[i]));
+        }
+        Call(ShardRequestKind::REMOVE, arguments);
+    }
+}
+
+int RemoteShard::GetDocumentCount() const {
+    const string result = Call(ShardRequestKind::DOCUMENT_COUNT, {});
+    PayloadReader reader(result);
+    return static_cast<int32_t>(reader.Read<uint32_t>());
+}
+
+RemoteShardedSearchServer::RemoteShardedSearchServer(const vector<string>& socket_paths) {
+    if (socket_paths.empty()) {
+        throw invalid_argument("Shard count must be positive");
+    }
+    for (const string& socket_path : socket_paths) {
+        shards_.push_back(make_unique<RemoteShard>(socket_path));
+    }
+}
+
+void RemoteShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    shards_[GetShardIndex(document_id)]->AddDocument(document_id, document, status, ratings);
+}
+
+void RemoteShardedSearchServer::RemoveDocument(int document_id) {
+    shards_[GetShardIndex(document_id)]->RemoveDocuments({ document_id });
+}
+
+void RemoteShardedSearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    vector<vector<int>> shard_document_ids(shards_.size());
+    for (const int document_id : document_ids) {
+        shard_document_ids[GetShardIndex(document_id)].push_back(document_id);
+    }
+    pool_->ParallelFor(0, shards_.size(), [&](size_t shard_index) {
+        shards_[shard_index]->RemoveDocuments(shard_document_ids[shard_index]);
+        }, 1);
+}
+
+vector<Document> RemoteShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, size_t top_count) const {
+    vector<QueryStatistics> shard_statistics(shards_.size());
+    pool_->ParallelFor(0, shards_.size(), [&](size_t shard_index) {
+        shard_statistics[shard_index] = shards_[shard_index]->GetQueryStatistics(raw_query);
+        }, 1);
+    QueryStatistics statistics;
+    for (const QueryStatistics& part : shard_statistics) {
+        statistics += part;
+    }
+    vector<vector<Document>> shard_documents(shards_.size());
+    pool_->ParallelFor(0, shards_.size(), [&](size_t shard_index) {
+        shard_documents[shard_index] = shards_[shard_index]->FindTopDocumentsWithStatistics(raw_query, statistics, status, top_count);
+        }, 1);
+    return MergeShardDocuments(shard_documents, top_count);
+}
+
+vector<Document> RemoteShardedSearchServer::FindTopDocuments(string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+RemoteShard::MatchDocumentResult RemoteShardedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    return shards_[GetShardIndex(document_id)]->MatchDocument(raw_query, document_id);
+}
+
+int RemoteShardedSearchServer::GetDocumentCount() const {
+    vector<int> shard_document_counts(shards_.size());
+    pool_->ParallelFor(0, shards_.size(), [&](size_t shard_index) {
+        shard_document_counts[shard_index] = shards_[shard_index]->GetDocumentCount();
+        }, 1);
+    int document_count = 0;
+    for (const int shard_document_count : shard_document_counts) {
+        document_count += shard_document_count;
+    }
+    return document_count;
+}
+
+size_t RemoteShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+size_t RemoteShardedSearchServer::GetShardIndex(int document_id) const {
+    return GetDocumentShardIndex(document_id, shards_.size());
+}
+
+void RemoteShardedSearchServer::SetPool(shared_ptr<WorkStealingPool> pool) {
+    pool_ = move(pool);
+}
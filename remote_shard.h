@@ -0,0 +1,168 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+#include "sharded_search_server.h"
+
+// Shards of a sharded search in processes of their own. A ShardWorker serves one SearchServer over a Unix domain
+// socket, a RemoteShard is its client, and RemoteShardedSearchServer searches all of them the way
+// ShardedSearchServer searches its in-process shards: QueryStatistics collected from every shard are summed and
+// sent back with the query, so relevances are the same as in one server holding all the documents.
+//
+// Messages are frames of query_protocol.h. A request payload is the request id (u64), the request kind (u8) and
+// its arguments, a response payload the request id, a ShardResponseStatus (u8) and either the result or an error
+// message. Only available on Linux; elsewhere the constructors of ShardWorker and RemoteShard throw.
+
+enum class ShardRequestKind : uint8_t {
+    STATISTICS = 0,
+    SEARCH = 1,
+    MATCH = 2,
+    ADD = 3,
+    REMOVE = 4,
+    DOCUMENT_COUNT = 5,
+};
+
+enum class ShardResponseStatus : uint8_t {
+    OK = 0,
+    // The shard threw std::invalid_argument, e.g. for an invalid query or a taken document id
+    INVALID_ARGUMENT = 1,
+    // The shard threw std::out_of_range, e.g. for a document it does not hold
+    OUT_OF_RANGE = 2,
+    // The shard failed otherwise, e.g. on damaged data of a loaded snapshot or a malformed request
+    FAILED = 3,
+};
+
+// Serves one shard to RemoteShard clients. Every connection is served by a thread of its own, one request at
+// a time. Requests of different connections that only read run at the same time, additions and removals wait
+// for them and run alone.
+class ShardWorker {
+public:
+    // Binds and listens on the socket path, removing a stale socket file left there.
+    // Throws std::runtime_error if the socket cannot be set up.
+    ShardWorker(SearchServer& search_server, const std::string& socket_path);
+
+    ShardWorker(const ShardWorker&) = delete;
+
+    ShardWorker& operator=(const ShardWorker&) = delete;
+
+    // Closes the socket and removes the socket file
+    ~ShardWorker();
+
+    // Serves connections until Stop is called, at most once per worker.
+    // Open connections are then shut down and waited for, a request being answered is finished first.
+    void Run();
+
+    // May be called from any thread and from a signal handler
+    void Stop();
+
+private:
+    SearchServer& search_server_;
+    const std::string socket_path_;
+    int listen_fd_ = -1;
+    // Wakes Run for Stop
+    int wake_fd_ = -1;
+    bool is_bound_ = false;
+    std::atomic<bool> is_stopping_{ false };
+    // Taken shared by requests that only read the server
+    std::shared_mutex server_mutex_;
+
+    // Guards the descriptors of the open connections, signaled when the last one is closed
+    std::mutex connections_mutex_;
+    std::condition_variable connections_closed_;
+    std::vector<int> connection_fds_;
+
+    void CloseDescriptors();
+    void ServeConnection(int fd);
+    void CloseConnection(int fd);
+    // Appends the response frame to the output
+    void AnswerRequest(std::string_view payload, std::string& output);
+};
+
+// Client of one ShardWorker over one connection. Calls may come from several threads, they are sent one at
+// a time and wait for their answer. An error the shard reports is thrown as the exception the shard threw,
+// std::invalid_argument or std::out_of_range, any other failure as std::runtime_error. A lost connection
+// throws std::runtime_error for this and every later call.
+class RemoteShard {
+public:
+    // MatchDocument of SearchServer, with the words copied out of the shard
+    using MatchDocumentResult = std::tuple<std::vector<std::string>, DocumentStatus>;
+
+    // Throws std::runtime_error if the worker cannot be reached
+    explicit RemoteShard(const std::string& socket_path);
+
+    RemoteShard(const RemoteShard&) = delete;
+
+    RemoteShard& operator=(const RemoteShard&) = delete;
+
+    ~RemoteShard();
+
+    QueryStatistics GetQueryStatistics(std::string_view raw_query) const;
+
+    // SearchServer::FindTopDocumentsWithStatistics for the documents with the given status
+    std::vector<Document> FindTopDocumentsWithStatistics(std::string_view raw_query, const QueryStatistics& statistics,
+        DocumentStatus status, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    MatchDocumentResult MatchDocument(std::string_view raw_query, int document_id) const;
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    int GetDocumentCount() const;
+
+private:
+    // Guards the connection, calls of const methods are sent over it too
+    mutable std::mutex mutex_;
+    mutable int fd_ = -1;
+    // Bytes received after the last response
+    mutable std::string input_;
+    mutable uint64_t next_request_id_ = 0;
+
+    // Sends a request and returns the result part of its response
+    std::string Call(ShardRequestKind kind, std::string_view arguments) const;
+    void Disconnect() const;
+};
+
+// ShardedSearchServer over shards served by ShardWorker processes, one RemoteShard per shard.
+// Documents are assigned to shards with GetDocumentShardIndex, so shards filled by a ShardedSearchServer with
+// the same shard count, e.g. from snapshots of its shards, can be served as they are. The shards must have the
+// same stop words. Only the status of a document can be filtered on, a predicate cannot cross processes.
+class RemoteShardedSearchServer {
+public:
+    // Connects to the workers in shard order, throws std::runtime_error if one cannot be reached
+    explicit RemoteShardedSearchServer(const std::vector<std::string>& socket_paths);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    RemoteShard::MatchDocumentResult MatchDocument(std::string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const;
+
+    size_t GetShardIndex(int document_id) const;
+
+    // Waits for the shards on this pool instead of the process-wide default one
+    void SetPool(std::shared_ptr<WorkStealingPool> pool);
+
+private:
+    std::vector<std::unique_ptr<RemoteShard>> shards_;
+    std::shared_ptr<WorkStealingPool> pool_ = WorkStealingPool::GetDefault();
+};
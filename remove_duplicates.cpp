@@ -1,28 +1,75 @@
 #include "remove_duplicates.h"
 
 #include <vector>
-#include <set>
 #include <string>
 #include <iostream>
 #include <algorithm>
+#include <cstdint>
 
 using namespace std;
 
+namespace {
+
+// splitmix64 finalizer, spreads consecutive term ids over all 64 bits
+uint64_t MixTermId(uint64_t x) {
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+// A sum does not depend on the order of the terms, and every term of a document is listed once
+uint64_t ComputeTermSetFingerprint(const WordFrequencies& word_freq) {
+	uint64_t fingerprint = word_freq.size();
+	for (size_t i = 0; i < word_freq.size(); ++i) {
+		fingerprint += MixTermId(word_freq.GetEntries()[i].term_id);
+	}
+	return fingerprint;
+}
+
+bool HaveSameTerms(const WordFrequencies& lhs, const WordFrequencies& rhs) {
+	return equal(lhs.GetEntries(), lhs.GetEntries() + lhs.size(), rhs.GetEntries(), rhs.GetEntries() + rhs.size(),
+		[](const TermFrequency& lhs_entry, const TermFrequency& rhs_entry) {
+			return lhs_entry.term_id == rhs_entry.term_id;
+		});
+}
+
+} // namespace
+
 void RemoveDuplicates(SearchServer& search_server) {
-	map<vector<string>, int> doc_words;
+	const vector<int> document_ids(search_server.begin(), search_server.end());
+	vector<pair<uint64_t, int>> fingerprints(document_ids.size());
+	search_server.GetPool().ParallelFor(0, document_ids.size(), [&](size_t i) {
+		fingerprints[i] = { ComputeTermSetFingerprint(search_server.GetWordFrequencies(document_ids[i])), document_ids[i] };
+		});
+	// Documents with equal fingerprints end up next to each other in id order, so the first of equal ones is kept
+	sort(fingerprints.begin(), fingerprints.end());
+
 	vector<int> duplicates;
-	for (const int document_id : search_server) {
-		auto word_freq = search_server.GetWordFrequencies(document_id);
-		vector<string> words(word_freq.size());
-		transform(word_freq.begin(), word_freq.end(), words.begin(), [](const pair<string_view, double>& elem) -> const string {
-			return string(elem.first); });
-		auto [_, emplaced] = doc_words.emplace(words, document_id);
-		if (!emplaced) {
-			duplicates.push_back(document_id);
+	vector<WordFrequencies> kept;
+	for (size_t group_begin = 0; group_begin < fingerprints.size();) {
+		size_t group_end = group_begin + 1;
+		while (group_end < fingerprints.size() && fingerprints[group_end].first == fingerprints[group_begin].first) {
+			++group_end;
 		}
+		// Fingerprints may collide, equal ones are confirmed term by term
+		kept.clear();
+		for (size_t i = group_begin; i < group_end; ++i) {
+			const int document_id = fingerprints[i].second;
+			const auto word_freq = search_server.GetWordFrequencies(document_id);
+			if (any_of(kept.begin(), kept.end(), [&word_freq](const WordFrequencies& other) { return HaveSameTerms(word_freq, other); })) {
+				duplicates.push_back(document_id);
+			}
+			else {
+				kept.push_back(word_freq);
+			}
+		}
+		group_begin = group_end;
 	}
+
+	sort(duplicates.begin(), duplicates.end());
 	for (const int document_id : duplicates) {
-		cout << "Found duplicate document id "s << document_id << endl;
-		search_server.RemoveDocument(document_id);
+		cout << "Found duplicate document id "s << document_id << '\n';
 	}
-}
\ No newline at end of file
+	search_server.RemoveDocuments(duplicates);
+}
@@ -1,6 +1,15 @@
+#include <algorithm>
+
 #include "request_queue.h"
 using namespace std;
 
+RequestQueue::RequestQueue(const SearchServer& search_server, size_t window_size)
+    : search_server_(search_server)
+    , window_size_(max<size_t>(window_size, 1))
+    , records_(make_unique<atomic<uint64_t>[]>(window_size_))
+    , record_times_(make_unique<atomic<int64_t>[]>(window_size_)) {
+}
+
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
     return AddFindRequest(raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
         return document_status == status;
@@ -11,6 +20,72 @@ vector<Document> RequestQueue::AddFindRequest(const string& raw_query) {
     return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
 }
 
+void RequestQueue::RecordRequest(size_t result_count, chrono::nanoseconds latency) {
+    const Clock::time_point now = Clock::now();
+    const uint64_t record = RECORD_USED
+        | min<uint64_t>(result_count, MAX_RECORD_RESULT_COUNT) << RECORD_LATENCY_BITS
+        | min<uint64_t>(static_cast<uint64_t>(max<int64_t>(latency.count(), 0)), RECORD_LATENCY_MASK);
+    // Only the counters have to add up, so nothing needs ordering beyond the atomicity of each operation
+    const size_t slot = next_record_.fetch_add(1, memory_order_relaxed) % window_size_;
+    record_times_[slot].store(chrono::duration_cast<chrono::nanoseconds>(now - start_time_).count(), memory_order_relaxed);
+    const uint64_t replaced_record = records_[slot].exchange(record, memory_order_relaxed);
+    CountRecord(record, 1);
+    if (replaced_record != 0) {
+        CountRecord(replaced_record, -1);
+    }
+}
+
 int RequestQueue::GetNoResultRequests() const {
-    return empty_res_;
-}
\ No newline at end of file
+    return static_cast<int>(max<int64_t>(no_result_count_.load(memory_order_relaxed), 0));
+}
+
+size_t RequestQueue::GetRequestCount() const {
+    return static_cast<size_t>(max<int64_t>(request_count_.load(memory_order_relaxed), 0));
+}
+
+double RequestQueue::GetNoResultRate() const {
+    const size_t request_count = GetRequestCount();
+    return request_count == 0 ? 0.0 : min(1.0, static_cast<double>(GetNoResultRequests()) / request_count);
+}
+
+double RequestQueue::GetRequestsPerSecond() const {
+    const uint64_t next_record = next_record_.load(memory_order_relaxed);
+    if (next_record == 0) {
+        return 0.0;
+    }
+    // The oldest request is in the slot written next, or in the first slot until the ring has filled up
+    const size_t oldest_slot = next_record < window_size_ ? 0 : next_record % window_size_;
+    const chrono::nanoseconds oldest_time(record_times_[oldest_slot].load(memory_order_relaxed));
+    const chrono::duration<double> window_duration = Clock::now() - (start_time_ + oldest_time);
+    return window_duration.count() <= 0.0 ? 0.0 : GetRequestCount() / window_duration.count();
+}
+
+chrono::nanoseconds RequestQueue::GetMeanLatency() const {
+    const size_t request_count = GetRequestCount();
+    if (request_count == 0) {
+        return chrono::nanoseconds(0);
+    }
+    return chrono::nanoseconds(max<int64_t>(latency_sum_.load(memory_order_relaxed), 0) / static_cast<int64_t>(request_count));
+}
+
+chrono::nanoseconds RequestQueue::GetLatencyPercentile(double percentile) const {
+    LatencyHistogram histogram;
+    for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+        histogram.AddToBucket(bucket, static_cast<uint64_t>(max<int64_t>(latency_buckets_[bucket].load(memory_order_relaxed), 0)));
+    }
+    return histogram.GetPercentile(percentile);
+}
+
+size_t RequestQueue::GetWindowSize() const {
+    return window_size_;
+}
+
+void RequestQueue::CountRecord(uint64_t record, int64_t sign) {
+    const uint64_t latency = record & RECORD_LATENCY_MASK;
+    request_count_.fetch_add(sign, memory_order_relaxed);
+    if (((record & ~RECORD_USED) >> RECORD_LATENCY_BITS) == 0) {
+        no_result_count_.fetch_add(sign, memory_order_relaxed);
+    }
+    latency_sum_.fetch_add(sign * static_cast<int64_t>(latency), memory_order_relaxed);
+    latency_buckets_[LatencyHistogram::GetBucket(latency)].fetch_add(sign, memory_order_relaxed);
+}
@@ -1,14 +1,25 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
-#include <deque>
 
+#include "latency_histogram.h"
 #include "search_server.h"
 
+// Health statistics over the last window_size search requests.
+// A request is kept as one packed word in a fixed ring, holding its result count and latency, and every
+// statistic is a counter updated when a request enters or leaves the window, so queries cost the same
+// whatever the window size. Requests may be added from many threads at once without locks or allocations.
+// While requests are being added the statistics can be off by the requests in flight.
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server) : search_server_(search_server) {
-    }
+    static constexpr size_t DEFAULT_WINDOW_SIZE = 1440;
+
+    explicit RequestQueue(const SearchServer& search_server, size_t window_size = DEFAULT_WINDOW_SIZE);
 
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
@@ -17,32 +28,61 @@ public:
 
     std::vector<Document> AddFindRequest(const std::string& raw_query);
 
+    // Adds a request served without this queue
+    void RecordRequest(size_t result_count, std::chrono::nanoseconds latency);
+
     int GetNoResultRequests() const;
+
+    // Requests in the window, up to the window size
+    size_t GetRequestCount() const;
+
+    double GetNoResultRate() const;
+
+    // Requests in the window divided by the time since the oldest of them
+    double GetRequestsPerSecond() const;
+
+    std::chrono::nanoseconds GetMeanLatency() const;
+
+    // Latency below which the given percent of the requests in the window stayed, e.g. 99.0 for p99.
+    // Latencies are counted in the buckets of LatencyHistogram, the upper end of the bucket is returned.
+    std::chrono::nanoseconds GetLatencyPercentile(double percentile) const;
+
+    size_t GetWindowSize() const;
+
 private:
-    struct QueryResult {
-        const std::vector<Document> result;
-    };
-    std::deque<QueryResult> requests_;
-    const static int sec_in_day_ = 1440;
-    int empty_res_ = 0;
+    using Clock = std::chrono::steady_clock;
+
+    // Record layout: the used bit, the result count and the latency in nanoseconds
+    static constexpr int RECORD_LATENCY_BITS = LatencyHistogram::LATENCY_BITS;
+    static constexpr uint64_t RECORD_USED = uint64_t{ 1 } << 63;
+    static constexpr uint64_t RECORD_LATENCY_MASK = LatencyHistogram::MAX_LATENCY;
+    // Larger counts are stored as this one, the statistics only tell empty results from the others
+    static constexpr uint64_t MAX_RECORD_RESULT_COUNT = (uint64_t{ 1 } << (63 - RECORD_LATENCY_BITS)) - 1;
+
     const SearchServer& search_server_;
+    const size_t window_size_;
+    const Clock::time_point start_time_ = Clock::now();
+    // Packed records of the ring, 0 for a slot that has not been used
+    std::unique_ptr<std::atomic<uint64_t>[]> records_;
+    // Nanoseconds from start_time_ to the end of the request in the same slot
+    std::unique_ptr<std::atomic<int64_t>[]> record_times_;
+    std::atomic<uint64_t> next_record_{ 0 };
+
+    // Counters of the requests in the window. A request may leave the window before a concurrent writer has
+    // counted it in, so the counters can be negative for a moment.
+    std::atomic<int64_t> request_count_{ 0 };
+    std::atomic<int64_t> no_result_count_{ 0 };
+    std::atomic<int64_t> latency_sum_{ 0 };
+    std::array<std::atomic<int64_t>, LatencyHistogram::BUCKET_COUNT> latency_buckets_{};
+
+    // Counts a packed record in or, with sign -1, out
+    void CountRecord(uint64_t record, int64_t sign);
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-    const std::vector<Document>& result = search_server_.FindTopDocuments(raw_query, document_predicate);
-    if (requests_.size() == sec_in_day_)
-    {
-        if (requests_.front().result.empty())
-        {
-            empty_res_--;
-        }
-        requests_.pop_front();
-    }
-    if (result.empty())
-    {
-        empty_res_++;
-    }
-    requests_.push_back({ result });
+    const Clock::time_point start_time = Clock::now();
+    std::vector<Document> result = search_server_.FindTopDocuments(raw_query, document_predicate);
+    RecordRequest(result.size(), Clock::now() - start_time);
     return result;
 }
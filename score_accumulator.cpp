@@ -0,0 +1,52 @@
+#include "score_accumulator.h"
+
+using namespace std;
+
+namespace {
+
+vector<unique_ptr<ScoreAccumulator>>& GetThreadFreeList() {
+    thread_local vector<unique_ptr<ScoreAccumulator>> free_list;
+    return free_list;
+}
+
+} // namespace
+
+void ScoreAccumulator::Reserve(size_t document_count) {
+    if (scores_.size() < document_count) {
+        scores_.resize(document_count, 0.0);
+        states_.resize(document_count, State::UNTOUCHED);
+    }
+}
+
+void ScoreAccumulator::Clear() {
+    for (const DocumentOrdinal document_ordinal : touched_) {
+        scores_[document_ordinal] = 0.0;
+        states_[document_ordinal] = State::UNTOUCHED;
+    }
+    touched_.clear();
+}
+
+ScoreAccumulatorPool::Lease::Lease(unique_ptr<ScoreAccumulator> accumulator)
+    : accumulator_(move(accumulator)) {
+}
+
+ScoreAccumulatorPool::Lease::~Lease() {
+    if (accumulator_) {
+        accumulator_->Clear();
+        GetThreadFreeList().push_back(move(accumulator_));
+    }
+}
+
+ScoreAccumulatorPool::Lease ScoreAccumulatorPool::Acquire(size_t document_count) {
+    auto& free_list = GetThreadFreeList();
+    unique_ptr<ScoreAccumulator> accumulator;
+    if (free_list.empty()) {
+        accumulator = make_unique<ScoreAccumulator>();
+    }
+    else {
+        accumulator = move(free_list.back());
+        free_list.pop_back();
+    }
+    accumulator->Reserve(document_count);
+    return Lease(move(accumulator));
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "posting_list.h"
+
+// Relevance accumulator indexed by document ordinal.
+// Only touched slots are remembered, so Clear costs O(touched) rather than O(documents).
+class ScoreAccumulator {
+public:
+    // Grows the accumulator so that ordinals below document_count can be used
+    void Reserve(size_t document_count);
+
+    void Add(DocumentOrdinal document_ordinal, double score) {
+        if (states_[document_ordinal] == State::UNTOUCHED) {
+            states_[document_ordinal] = State::SCORED;
+            touched_.push_back(document_ordinal);
+        }
+        scores_[document_ordinal] += score;
+    }
+
+    // An excluded document is never reported, even if it gets scored later
+    void Exclude(DocumentOrdinal document_ordinal) {
+        if (states_[document_ordinal] == State::UNTOUCHED) {
+            touched_.push_back(document_ordinal);
+        }
+        states_[document_ordinal] = State::EXCLUDED;
+    }
+
+    bool IsExcluded(DocumentOrdinal document_ordinal) const {
+        return states_[document_ordinal] == State::EXCLUDED;
+    }
+
+    // A scored document has been accepted once, so callers need not check it again
+    bool IsScored(DocumentOrdinal document_ordinal) const {
+        return states_[document_ordinal] == State::SCORED;
+    }
+
+    template <typename Func>
+    void ForEachScored(Func func) const {
+        for (const DocumentOrdinal document_ordinal : touched_) {
+            if (states_[document_ordinal] == State::SCORED) {
+                func(document_ordinal, scores_[document_ordinal]);
+            }
+        }
+    }
+
+    void Clear();
+
+private:
+    enum class State : uint8_t {
+        UNTOUCHED,
+        SCORED,
+        EXCLUDED,
+    };
+
+    std::vector<double> scores_;
+    std::vector<State> states_;
+    std::vector<DocumentOrdinal> touched_;
+};
+
+// Hands out accumulators from a free list of the calling thread, so queries do not allocate once warmed up.
+// Nested queries on one thread simply take another accumulator.
+class ScoreAccumulatorPool {
+public:
+    class Lease {
+    public:
+        explicit Lease(std::unique_ptr<ScoreAccumulator> accumulator);
+
+        Lease(Lease&&) = default;
+
+        Lease& operator=(Lease&&) = delete;
+
+        ~Lease();
+
+        ScoreAccumulator& operator*() const {
+            return *accumulator_;
+        }
+
+        ScoreAccumulator* operator->() const {
+            return accumulator_.get();
+        }
+
+    private:
+        std::unique_ptr<ScoreAccumulator> accumulator_;
+    };
+
+    static Lease Acquire(size_t document_count);
+};
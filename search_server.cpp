@@ -1,5 +1,10 @@
 ﻿#include <stdexcept>
+#include <cstddef>
 #include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <unordered_map>
 
 #include "string_processing.h"
 #include "search_server.h"
@@ -16,28 +21,368 @@ SearchServer::SearchServer(string_view stop_words_text)
 {
 }
 
+SearchServer::SearchServer(const SearchServer& other)
+    : stop_words_(other.stop_words_)
+    , terms_(other.terms_)
+    , term_postings_(other.term_postings_)
+    , documents_(other.documents_)
+    , term_freqs_(other.term_freqs_)
+    , removed_term_freq_count_(other.removed_term_freq_count_)
+    , tombstones_(other.tombstones_)
+    , unmerged_removals_(other.unmerged_removals_)
+    , term_tombstone_counts_(other.term_tombstone_counts_)
+    , document_ordinals_(other.document_ordinals_)
+    , document_ids_(other.document_ids_)
+    , index_generation_(other.index_generation_)
+    , pool_(other.pool_)
+    , snapshot_file_(other.snapshot_file_)
+{
+    // Texts of a mapped snapshot stay shared, the snapshot is kept mapped by snapshot_file_
+    for (DocumentData& document_data : documents_) {
+        if (other.document_texts_.Contains(document_data.document_text)) {
+            document_data.document_text = document_texts_.Append(document_data.document_text);
+        }
+    }
+    if (other.result_cache_) {
+        SetResultCacheCapacity(other.result_cache_->GetStats().capacity);
+    }
+}
+
+namespace {
+
+// Fixed-size part of a document in a snapshot, texts and term frequencies of all documents follow in two arrays
+struct SnapshotDocument {
+    int32_t id;
+    int32_t rating;
+    int32_t status;
+    uint32_t reserved;
+    double inv_word_count;
+    uint64_t text_offset;
+    uint64_t text_size;
+    uint64_t term_freq_offset;
+    uint64_t term_freq_count;
+};
+
+struct SnapshotDocumentOrdinal {
+    int32_t id;
+    DocumentOrdinal ordinal;
+};
+
+// TermFrequency with its padding written out as zeros, so equal indexes give byte-identical snapshots.
+// The layouts match, and the loaded array is used in place as TermFrequency.
+struct SnapshotTermFreq {
+    TermDictionary::TermId term_id;
+    uint32_t reserved;
+    double term_freq;
+};
+
+static_assert(sizeof(SnapshotTermFreq) == sizeof(TermFrequency)
+    && offsetof(SnapshotTermFreq, term_id) == offsetof(TermFrequency, term_id)
+    && offsetof(SnapshotTermFreq, term_freq) == offsetof(TermFrequency, term_freq));
+
+} // namespace
+
+SearchServer::SearchServer(SnapshotReader& reader)
+    : stop_words_(LoadStopWords(reader))
+    , terms_(TermDictionary::Load(reader))
+    , snapshot_file_(reader.GetFile())
+{
+    const auto term_count = reader.ReadValue<uint64_t>();
+    if (term_count != terms_.size()) {
+        throw runtime_error("Snapshot is corrupted");
+    }
+    term_postings_.reserve(term_count);
+    for (uint64_t i = 0; i < term_count; ++i) {
+        term_postings_.push_back(PostingList::Load(reader));
+    }
+    // Removals are merged before saving
+    term_tombstone_counts_.resize(term_count);
+
+    const auto snapshot_documents = reader.ReadArray<SnapshotDocument>();
+    const auto texts = reader.ReadArray<char>();
+    term_freqs_ = reader.ReadArray<TermFreq>();
+    documents_.reserve(snapshot_documents.size());
+    // The document table is read anyway, so its offsets are checked against the sections they index here.
+    // Postings, terms and term frequencies are only checked when they are read, loading does not walk them.
+    for (const SnapshotDocument& document : snapshot_documents) {
+        if (document.text_offset > texts.size() || document.text_size > texts.size() - document.text_offset
+            || document.term_freq_offset > term_freqs_.size() || document.term_freq_count > term_freqs_.size() - document.term_freq_offset
+            || document.status < static_cast<int32_t>(DocumentStatus::ACTUAL) || document.status > static_cast<int32_t>(DocumentStatus::REMOVED)) {
+            throw runtime_error("Snapshot is corrupted");
+        }
+        documents_.push_back({ document.id, document.rating, static_cast<DocumentStatus>(document.status),
+            string_view(texts.data() + document.text_offset, document.text_size),
+            document.inv_word_count, document.term_freq_offset, document.term_freq_count });
+    }
+
+    for (const PostingList& postings : term_postings_) {
+        if (!postings.HasOrdinalsBelow(documents_.size())) {
+            throw runtime_error("Snapshot is corrupted");
+        }
+    }
+
+    // Slots without a document were removed before saving
+    tombstones_.assign(documents_.size(), true);
+    // Saved in id order, so every insertion goes right before the end
+    for (const SnapshotDocumentOrdinal& document : reader.ReadArray<SnapshotDocumentOrdinal>()) {
+        if (document.ordinal >= documents_.size()) {
+            throw runtime_error("Snapshot is corrupted");
+        }
+        tombstones_[document.ordinal] = false;
+        document_ordinals_.emplace_hint(document_ordinals_.end(), document.id, document.ordinal);
+        document_ids_.emplace_hint(document_ids_.end(), document.id);
+    }
+}
+
+set<string, less<>> SearchServer::LoadStopWords(SnapshotReader& reader) {
+    set<string, less<>> stop_words;
+    const auto stop_word_count = reader.ReadValue<uint64_t>();
+    for (uint64_t i = 0; i < stop_word_count; ++i) {
+        stop_words.emplace(reader.ReadString());
+    }
+    return stop_words;
+}
+
+SearchServer SearchServer::LoadSnapshot(const string& path, SnapshotVerification verification) {
+    SnapshotReader reader(make_shared<MappedFile>(path), verification);
+    return SearchServer(reader);
+}
+
+void SearchServer::SaveSnapshot(const string& path) const {
+    SnapshotWriter writer(path);
+    writer.WriteValue(static_cast<uint64_t>(stop_words_.size()));
+    for (const string& stop_word : stop_words_) {
+        writer.WriteString(stop_word);
+    }
+    terms_.Save(writer);
+    writer.WriteValue(static_cast<uint64_t>(term_postings_.size()));
+    // Pending removals are merged into copies of the lists they touch, so a snapshot never has tombstones
+    vector<pair<TermId, DocumentOrdinal>> unmerged_removals = unmerged_removals_;
+    sort(unmerged_removals.begin(), unmerged_removals.end());
+    auto removal_it = unmerged_removals.begin();
+    for (TermId term_id = 0; term_id < term_postings_.size(); ++term_id) {
+        if (removal_it == unmerged_removals.end() || removal_it->first != term_id) {
+            term_postings_[term_id].Save(writer);
+            continue;
+        }
+        PostingList postings = term_postings_[term_id];
+        for (; removal_it != unmerged_removals.end() && removal_it->first == term_id; ++removal_it) {
+            postings.Remove(removal_it->second);
+        }
+        postings.Save(writer);
+    }
+
+    vector<SnapshotDocument> snapshot_documents;
+    snapshot_documents.reserve(documents_.size());
+    uint64_t text_size = 0;
+    uint64_t term_freq_count = 0;
+    for (const DocumentData& document : documents_) {
+        snapshot_documents.push_back({ document.id, document.rating, static_cast<int32_t>(document.status), 0, document.inv_word_count,
+            text_size, document.document_text.size(), term_freq_count, document.term_freq_count });
+        text_size += document.document_text.size();
+        term_freq_count += document.term_freq_count;
+    }
+    string texts;
+    texts.reserve(text_size);
+    vector<SnapshotTermFreq> term_freqs;
+    term_freqs.reserve(term_freq_count);
+    for (const DocumentData& document : documents_) {
+        texts += document.document_text;
+        for (const TermFreq& term_freq : GetTermFreqs(document)) {
+            term_freqs.push_back({ term_freq.term_id, 0, term_freq.term_freq });
+        }
+    }
+    writer.WriteArray(snapshot_documents);
+    writer.WriteString(texts);
+    writer.WriteArray(term_freqs);
+
+    vector<SnapshotDocumentOrdinal> document_ordinals;
+    document_ordinals.reserve(document_ordinals_.size());
+    for (const auto [document_id, document_ordinal] : document_ordinals_) {
+        document_ordinals.push_back({ document_id, document_ordinal });
+    }
+    writer.WriteArray(document_ordinals);
+    writer.Finish();
+}
+
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    METRICS_TIMER("index.add_document");
+    if ((document_id < 0) || (document_ordinals_.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
-    string doc_text = string(document);
-    const auto words = SplitIntoWordsNoStop(doc_text);
+    static thread_local vector<string_view> words;
+    SplitIntoWordsNoStop(document, words);
 
+    const DocumentOrdinal document_ordinal = static_cast<DocumentOrdinal>(documents_.size());
     const double inv_word_count = 1.0 / words.size();
-    map<string_view, double> word_freq;
+    map<TermId, uint32_t> term_counts;
     for (const string_view word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        word_freq[word] += inv_word_count;
+        ++term_counts[terms_.Intern(word)];
     }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status, move(doc_text), word_freq });
+    term_postings_.resize(terms_.size());
+    term_tombstone_counts_.resize(terms_.size());
+    vector<TermFreq>& term_freqs = term_freqs_.GetMutable();
+    const size_t term_freq_offset = term_freqs.size();
+    for (const auto [term_id, term_count] : term_counts) {
+        const double term_freq = term_count * inv_word_count;
+        term_freqs.push_back({ term_id, term_freq });
+        term_postings_[term_id].Add(document_ordinal, term_count, term_freq);
+    }
+    documents_.push_back({ document_id, ComputeAverageRating(ratings), status, document_texts_.Append(document), inv_word_count,
+        term_freq_offset, term_counts.size() });
+    tombstones_.push_back(false);
+    document_ordinals_.emplace(document_id, document_ordinal);
     document_ids_.insert(document_id);
+    ++index_generation_;
+    METRICS_COUNT("index.documents_added", 1);
+}
+
+void SearchServer::AddDocuments(const vector<DocumentInput>& documents) {
+    // Ids are checked first, as AddDocument does
+    CheckNewDocumentIds(documents);
+    AddCheckedDocuments(PrepareDocuments(documents));
+}
+
+void SearchServer::CheckNewDocumentIds(const vector<DocumentInput>& documents) const {
+    set<int> batch_ids;
+    for (const DocumentInput& document : documents) {
+        if ((document.id < 0) || (document_ordinals_.count(document.id) > 0) || !batch_ids.insert(document.id).second) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+    }
+}
+
+SearchServer::PreparedDocuments SearchServer::PrepareDocuments(vector<DocumentInput> documents) const {
+    METRICS_TIMER("index.prepare_documents");
+    PreparedDocuments prepared;
+    if (documents.empty()) {
+        return prepared;
+    }
+    prepared.documents_ = move(documents);
+    const vector<DocumentInput>& batch = prepared.documents_;
+    const size_t range_count = clamp<size_t>(batch.size() / MIN_INGESTION_RANGE_SIZE, 1, pool_->GetWorkerCount() * 4);
+    for (size_t range = 0; range <= range_count; ++range) {
+        prepared.range_begins_.push_back(batch.size() * range / range_count);
+    }
+    prepared.partial_indexes_.resize(range_count);
+    prepared.inv_word_counts_.resize(batch.size());
+    pool_->ParallelFor(0, range_count, [this, &prepared, &batch](size_t range) {
+        PreparedDocuments::PartialIndex& index = prepared.partial_indexes_[range];
+        vector<string_view> words;
+        vector<uint32_t> local_ids;
+        for (size_t position = prepared.range_begins_[range]; position < prepared.range_begins_[range + 1]; ++position) {
+            SplitIntoWordsNoStop(batch[position].text, words);
+            prepared.inv_word_counts_[position] = 1.0 / words.size();
+            local_ids.clear();
+            for (const string_view word : words) {
+                const auto [it, inserted] = index.term_ids.emplace(word, static_cast<uint32_t>(index.terms.size()));
+                if (inserted) {
+                    index.terms.push_back(word);
+                    index.postings.emplace_back();
+                }
+                local_ids.push_back(it->second);
+            }
+            sort(local_ids.begin(), local_ids.end());
+            auto& document_terms = index.document_terms.emplace_back();
+            for (size_t i = 0; i < local_ids.size(); ++i) {
+                if (i == 0 || local_ids[i] != local_ids[i - 1]) {
+                    document_terms.push_back({ local_ids[i], 0 });
+                }
+                ++document_terms.back().count;
+            }
+            for (const auto [local_id, term_count] : document_terms) {
+                index.postings[local_id].push_back({ static_cast<DocumentOrdinal>(position), term_count });
+            }
+        }
+        }, 1);
+    return prepared;
+}
+
+void SearchServer::AddPreparedDocuments(PreparedDocuments prepared) {
+    CheckNewDocumentIds(prepared.documents_);
+    AddCheckedDocuments(move(prepared));
+}
+
+void SearchServer::AddCheckedDocuments(PreparedDocuments prepared) {
+    METRICS_TIMER("index.add_documents");
+    const vector<DocumentInput>& documents = prepared.documents_;
+    if (documents.empty()) {
+        return;
+    }
+    const size_t range_count = prepared.partial_indexes_.size();
+    const auto& partial_indexes = prepared.partial_indexes_;
+    const auto& inv_word_counts = prepared.inv_word_counts_;
+
+    // The whole batch is valid, the partial indexes are merged range by range
+    const auto first_ordinal = static_cast<DocumentOrdinal>(documents_.size());
+    vector<vector<TermId>> global_term_ids(range_count);
+    for (size_t range = 0; range < range_count; ++range) {
+        for (const string_view term : partial_indexes[range].terms) {
+            global_term_ids[range].push_back(terms_.Intern(term));
+        }
+    }
+    term_postings_.resize(terms_.size());
+    term_tombstone_counts_.resize(terms_.size());
+    for (size_t range = 0; range < range_count; ++range) {
+        const PreparedDocuments::PartialIndex& index = partial_indexes[range];
+        for (size_t local_id = 0; local_id < index.postings.size(); ++local_id) {
+            PostingList& postings = term_postings_[global_term_ids[range][local_id]];
+            for (const auto [position, term_count] : index.postings[local_id]) {
+                postings.Add(first_ordinal + position, term_count, term_count * inv_word_counts[position]);
+            }
+        }
+    }
+
+    // The arena is not thread-safe, texts are copied before the parallel pass
+    vector<string_view> stored_texts;
+    stored_texts.reserve(documents.size());
+    for (const DocumentInput& document : documents) {
+        stored_texts.push_back(document_texts_.Append(document.text));
+    }
+    // Every document gets its slice of the forward index up front, so the slices are filled in parallel
+    vector<TermFreq>& term_freqs = term_freqs_.GetMutable();
+    vector<size_t> term_freq_offsets;
+    term_freq_offsets.reserve(documents.size());
+    size_t term_freq_offset = term_freqs.size();
+    for (size_t range = 0; range < range_count; ++range) {
+        for (const auto& document_terms : partial_indexes[range].document_terms) {
+            term_freq_offsets.push_back(term_freq_offset);
+            term_freq_offset += document_terms.size();
+        }
+    }
+    term_freqs.resize(term_freq_offset);
+    documents_.resize(documents_.size() + documents.size());
+    tombstones_.resize(documents_.size());
+    pool_->ParallelFor(0, range_count, [&](size_t range) {
+        const size_t range_begin = prepared.range_begins_[range];
+        for (size_t position = range_begin; position < prepared.range_begins_[range + 1]; ++position) {
+            const DocumentInput& document = documents[position];
+            const double inv_word_count = inv_word_counts[position];
+            const auto& document_terms = partial_indexes[range].document_terms[position - range_begin];
+            TermFreq* document_term_freqs = term_freqs.data() + term_freq_offsets[position];
+            for (size_t i = 0; i < document_terms.size(); ++i) {
+                document_term_freqs[i] = { global_term_ids[range][document_terms[i].local_id], document_terms[i].count * inv_word_count };
+            }
+            sort(document_term_freqs, document_term_freqs + document_terms.size(), [](const TermFreq& lhs, const TermFreq& rhs) {
+                return lhs.term_id < rhs.term_id;
+                });
+            documents_[first_ordinal + position] = { document.id, ComputeAverageRating(document.ratings), document.status,
+                stored_texts[position], inv_word_count, term_freq_offsets[position], document_terms.size() };
+        }
+        }, 1);
+    for (size_t position = 0; position < documents.size(); ++position) {
+        document_ordinals_.emplace(documents[position].id, first_ordinal + static_cast<DocumentOrdinal>(position));
+        document_ids_.insert(documents[position].id);
+    }
+    ++index_generation_;
+    METRICS_COUNT("index.documents_added", documents.size());
 }
 
 //неявно последовательное выполнение
-vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, size_t top_count) const {
+    return FindTopDocumentsCached(execution::seq, raw_query, GetStatusTag(status), [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
         return document_status == status;
-        });
+        }, top_count);
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
@@ -45,10 +390,10 @@ vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
 }
 
 //явно последовательное выполнение
-vector<Document> SearchServer::FindTopDocuments(const execution::sequenced_policy&, string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
+vector<Document> SearchServer::FindTopDocuments(const execution::sequenced_policy&, string_view raw_query, DocumentStatus status, size_t top_count) const {
+    return FindTopDocumentsCached(execution::seq, raw_query, GetStatusTag(status), [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
         return document_status == status;
-        });
+        }, top_count);
 }
 
 vector<Document> SearchServer::FindTopDocuments(const execution::sequenced_policy&, string_view raw_query) const {
@@ -56,18 +401,186 @@ vector<Document> SearchServer::FindTopDocuments(const execution::sequenced_polic
 }
 
 //явно параллельное выполнение
-vector<Document> SearchServer::FindTopDocuments(const execution::parallel_policy&, string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(execution::par, raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
+vector<Document> SearchServer::FindTopDocuments(const execution::parallel_policy&, string_view raw_query, DocumentStatus status, size_t top_count) const {
+    return FindTopDocumentsCached(execution::par, raw_query, GetStatusTag(status), [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
         return document_status == status;
-        });
+        }, top_count);
 }
 
 vector<Document> SearchServer::FindTopDocuments(const execution::parallel_policy&, string_view raw_query) const {
     return FindTopDocuments(execution::par, raw_query, DocumentStatus::ACTUAL);
 }
 
+vector<Document> SearchServer::FindTopDocumentsPage(string_view raw_query, DocumentStatus status, size_t offset, size_t limit) const {
+    return FindTopDocumentsPage(raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
+        return document_status == status;
+        }, offset, limit);
+}
+
+vector<Document> SearchServer::FindTopDocumentsAfter(string_view raw_query, DocumentStatus status, const ResultCursor& cursor, size_t limit) const {
+    return FindTopDocumentsAfter(raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
+        return document_status == status;
+        }, cursor, limit);
+}
+
+BatchSearchResult SearchServer::FindTopDocumentsBatch(const vector<string>& raw_queries) const {
+    vector<Query> queries;
+    queries.reserve(raw_queries.size());
+    for (const string& raw_query : raw_queries) {
+        queries.push_back(ParseQuery(raw_query));
+    }
+
+    // Queries are grouped by their longest posting list, the one that is most expensive to walk
+    vector<TermId> longest_terms(queries.size(), TermDictionary::NO_TERM);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        for (const QueryTerm& term : queries[i].plus_terms) {
+            if (term.term_id != TermDictionary::NO_TERM
+                && (longest_terms[i] == TermDictionary::NO_TERM || term_postings_[term.term_id].size() > term_postings_[longest_terms[i]].size())) {
+                longest_terms[i] = term.term_id;
+            }
+        }
+    }
+    vector<size_t> query_order(queries.size());
+    iota(query_order.begin(), query_order.end(), 0);
+    stable_sort(query_order.begin(), query_order.end(), [&longest_terms](size_t lhs, size_t rhs) {
+        return longest_terms[lhs] < longest_terms[rhs];
+        });
+
+    vector<vector<Document>> results(queries.size());
+    pool_->ParallelFor(
+        0, (queries.size() + BATCH_QUERY_CHUNK_SIZE - 1) / BATCH_QUERY_CHUNK_SIZE,
+        [this, &queries, &query_order, &results](size_t chunk) {
+            const size_t first_query = chunk * BATCH_QUERY_CHUNK_SIZE;
+            const size_t query_count = min(BATCH_QUERY_CHUNK_SIZE, queries.size() - first_query);
+            FindTopDocumentsChunk(queries, query_order.data() + first_query, query_count, results);
+        },
+        1);
+
+    BatchSearchResult batch;
+    batch.offsets.reserve(results.size() + 1);
+    for (const vector<Document>& documents : results) {
+        batch.documents.insert(batch.documents.end(), documents.begin(), documents.end());
+        batch.offsets.push_back(batch.documents.size());
+    }
+    return batch;
+}
+
+void SearchServer::FindTopDocumentsChunk(const vector<Query>& queries, const size_t* query_indices, size_t query_count,
+    vector<vector<Document>>& results) const {
+    METRICS_TIMER("query.batch_chunk");
+    // A term of the chunk with the positions of the chunk queries that contain it
+    struct ChunkTerm {
+        TermId term_id;
+        vector<uint32_t> query_positions;
+    };
+    const auto collect_terms = [&queries, query_indices, query_count](const vector<QueryTerm> Query::* terms) {
+        vector<pair<const QueryTerm*, uint32_t>> occurrences;
+        for (uint32_t position = 0; position < query_count; ++position) {
+            for (const QueryTerm& term : queries[query_indices[position]].*terms) {
+                if (term.term_id != TermDictionary::NO_TERM) {
+                    occurrences.emplace_back(&term, position);
+                }
+            }
+        }
+        // Every query gets its contributions in word order, like the single query search sums them
+        sort(occurrences.begin(), occurrences.end(), [](const auto& lhs, const auto& rhs) {
+            return make_pair(lhs.first->word, lhs.second) < make_pair(rhs.first->word, rhs.second);
+            });
+        vector<ChunkTerm> chunk_terms;
+        for (const auto& [term, position] : occurrences) {
+            if (chunk_terms.empty() || chunk_terms.back().term_id != term->term_id) {
+                chunk_terms.push_back({ term->term_id, {} });
+            }
+            chunk_terms.back().query_positions.push_back(position);
+        }
+        return chunk_terms;
+    };
+    const vector<ChunkTerm> plus_terms = collect_terms(&Query::plus_terms);
+    const vector<ChunkTerm> minus_terms = collect_terms(&Query::minus_terms);
+    vector<double> inverse_document_freqs(plus_terms.size());
+    for (size_t i = 0; i < plus_terms.size(); ++i) {
+        inverse_document_freqs[i] = ComputeTermInverseDocumentFreq(plus_terms[i].term_id);
+    }
+
+    // Accumulators are indexed by the ordinal offset inside the current range
+    vector<ScoreAccumulator> accumulators(query_count);
+    for (ScoreAccumulator& accumulator : accumulators) {
+        accumulator.Reserve(BATCH_ORDINAL_RANGE_SIZE);
+    }
+    vector<TopDocumentsSelector> selectors(query_count, TopDocumentsSelector(MAX_RESULT_DOCUMENT_COUNT, DocumentRelevanceGreater{}));
+
+    const size_t document_count = documents_.size();
+    for (size_t first = 0; first < document_count; first += BATCH_ORDINAL_RANGE_SIZE) {
+        const auto first_ordinal = static_cast<DocumentOrdinal>(first);
+        const auto last_ordinal = static_cast<DocumentOrdinal>(min(first + BATCH_ORDINAL_RANGE_SIZE, document_count));
+        for (const ChunkTerm& term : minus_terms) {
+            term_postings_[term.term_id].ForEachInRange(first_ordinal, last_ordinal, [&](DocumentOrdinal document_ordinal, uint32_t) {
+                for (const uint32_t position : term.query_positions) {
+                    accumulators[position].Exclude(document_ordinal - first_ordinal);
+                }
+                });
+        }
+        for (size_t i = 0; i < plus_terms.size(); ++i) {
+            const ChunkTerm& term = plus_terms[i];
+            const double inverse_document_freq = inverse_document_freqs[i];
+            term_postings_[term.term_id].ForEachInRange(first_ordinal, last_ordinal, [&](DocumentOrdinal document_ordinal, uint32_t term_count) {
+                const auto& document_data = documents_[document_ordinal];
+                if (document_data.status != DocumentStatus::ACTUAL || tombstones_[document_ordinal]) {
+                    return;
+                }
+                const double relevance = term_count * document_data.inv_word_count * inverse_document_freq;
+                for (const uint32_t position : term.query_positions) {
+                    if (!accumulators[position].IsExcluded(document_ordinal - first_ordinal)) {
+                        accumulators[position].Add(document_ordinal - first_ordinal, relevance);
+                    }
+                }
+                });
+        }
+        for (size_t position = 0; position < query_count; ++position) {
+            accumulators[position].ForEachScored([this, first_ordinal, &selector = selectors[position]](DocumentOrdinal offset, double relevance) {
+                const auto& document_data = documents_[first_ordinal + offset];
+                selector.Push({ document_data.id, relevance, document_data.rating });
+                });
+            accumulators[position].Clear();
+        }
+    }
+
+    for (size_t position = 0; position < query_count; ++position) {
+        results[query_indices[position]] = selectors[position].ExtractSorted();
+    }
+}
+
+void SearchServer::SetWorkerCount(size_t worker_count) {
+    pool_ = make_shared<WorkStealingPool>(worker_count);
+}
+
+void SearchServer::SetPool(shared_ptr<WorkStealingPool> pool) {
+    pool_ = move(pool);
+}
+
+vector<WorkStealingPool::WorkerStats> SearchServer::GetWorkerStats() const {
+    return pool_->GetWorkerStats();
+}
+
+WorkStealingPool& SearchServer::GetPool() const {
+    return *pool_;
+}
+
+void SearchServer::SetResultCacheCapacity(size_t capacity) {
+    if (capacity == 0) {
+        result_cache_.reset();
+    }
+    else {
+        result_cache_ = make_unique<QueryResultCache>(capacity);
+    }
+}
+
+QueryResultCache::Stats SearchServer::GetResultCacheStats() const {
+    return result_cache_ ? result_cache_->GetStats() : QueryResultCache::Stats{};
+}
+
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return document_ids_.size();
 }
 
 SearchServer::MatchDocumentResult SearchServer::MatchDocument(const string_view raw_query, int document_id) const {
@@ -79,54 +592,61 @@ SearchServer::MatchDocumentResult SearchServer::MatchDocument(
     std::string_view raw_query, int document_id) const {
 
     const auto query = ParseQuery(raw_query);
-
-    if (any_of(execution::par, query.minus_words.begin(), query.minus_words.end(),
-        [this, document_id](string_view word) {
-            return word_to_document_freqs_.count(word) != 0 && word_to_document_freqs_.at(word).count(document_id); })) {
-        return { std::vector<std::string_view>({}), documents_.at(document_id).status };
+    const DocumentOrdinal document_ordinal = document_ordinals_.at(document_id);
+
+    const auto contains_document = [this, document_ordinal](const QueryTerm& term) {
+        return term.term_id != TermDictionary::NO_TERM && term_postings_[term.term_id].Contains(document_ordinal);
+    };
+
+    // Every task writes only the flags of its own terms
+    vector<char> contains_minus(query.minus_terms.size());
+    pool_->ParallelFor(0, query.minus_terms.size(), [&](size_t i) {
+        contains_minus[i] = contains_document(query.minus_terms[i]);
+        }, PARALLEL_TERM_GRAIN_SIZE);
+    if (any_of(contains_minus.begin(), contains_minus.end(), [](char contains) { return contains; })) {
+        return { std::vector<std::string_view>({}), documents_[document_ordinal].status };
     }
 
-    vector<string_view> matched_words;
+    vector<char> contains_plus(query.plus_terms.size());
+    pool_->ParallelFor(0, query.plus_terms.size(), [&](size_t i) {
+        contains_plus[i] = contains_document(query.plus_terms[i]);
+        }, PARALLEL_TERM_GRAIN_SIZE);
 
-    for_each(
-        execution::par,
-        query.plus_words.begin(), query.plus_words.end(),
-        [this, document_id, &matched_words](string_view word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return;
-            }
-            if (word_to_document_freqs_.at(word).count(document_id)) {
-                matched_words.push_back(word);
-            }
-        });   
+    vector<string_view> matched_words;
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        if (contains_plus[i]) {
+            matched_words.push_back(query.plus_terms[i].word);
+        }
+    }
 
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, documents_[document_ordinal].status };
 }
 
 SearchServer::MatchDocumentResult SearchServer::MatchDocument(
     const std::execution::sequenced_policy&,
     std::string_view raw_query, int document_id) const {
     const auto query = ParseQuery(raw_query);
+    const DocumentOrdinal document_ordinal = document_ordinals_.at(document_id);
 
     vector<string_view> matched_words;
-    for (const string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    for (const QueryTerm& term : query.plus_terms) {
+        if (term.term_id == TermDictionary::NO_TERM) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+        if (term_postings_[term.term_id].Contains(document_ordinal)) {
+            matched_words.push_back(term.word);
         }
     }
-    for (const string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    for (const QueryTerm& term : query.minus_terms) {
+        if (term.term_id == TermDictionary::NO_TERM) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
+        if (term_postings_[term.term_id].Contains(document_ordinal)) {
             matched_words.clear();
             break;
         }
     }
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, documents_[document_ordinal].status };
 }
 
 void SearchServer::RemoveDocument(int document_id) {
@@ -134,51 +654,132 @@ void SearchServer::RemoveDocument(int document_id) {
 }
 
 void SearchServer::RemoveDocument(const execution::sequenced_policy&, int document_id) {
-    if (documents_.count(document_id) == 0) {
-        return;
+    METRICS_TIMER("index.remove_document");
+    if (MarkRemoved(document_id)) {
+        MergeRemovalsIfNeeded();
+        ++index_generation_;
     }
+}
+
+void SearchServer::RemoveDocument(const execution::parallel_policy&, int document_id) {
+    RemoveDocument(execution::seq, document_id);
+}
 
-    for (const auto [word, _] : GetWordFrequencies(document_id)) {
-        word_to_document_freqs_.at(word).erase(document_id);
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    METRICS_TIMER("index.remove_documents");
+    bool is_removed = false;
+    for (const int document_id : document_ids) {
+        is_removed |= MarkRemoved(document_id);
+    }
+    if (is_removed) {
+        MergeRemovalsIfNeeded();
+        ++index_generation_;
     }
-    documents_.erase(document_id);
-    document_ids_.erase(document_id);
 }
 
-void SearchServer::RemoveDocument(const execution::parallel_policy&, int document_id) {
-    if (documents_.count(document_id) == 0) {
-        return;
+void SearchServer::CompactIndex() {
+    MergeRemovals();
+}
+
+WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    const auto ordinal_it = document_ordinals_.find(document_id);
+    if (ordinal_it == document_ordinals_.end()) {
+        return {};
     }
+    const auto term_freqs = GetTermFreqs(documents_[ordinal_it->second]);
+    return { &terms_, term_freqs.data(), term_freqs.data() + term_freqs.size() };
+}
 
-    const auto words_freq = GetWordFrequencies(document_id);
+map<string_view, double> SearchServer::GetWordFrequencyMap(int document_id) const {
+    return GetWordFrequencies(document_id).ToMap();
+}
 
-    for_each(
-        execution::par,
-        words_freq.begin(), words_freq.end(),
-        [this, document_id](const auto& word_freq) {
-            word_to_document_freqs_.at(word_freq.first).erase(document_id);
-        });
+set<int>::const_iterator SearchServer::begin() const {
+    return document_ids_.begin();
+}
+
+set<int>::const_iterator SearchServer::end() const {
+    return document_ids_.end();
+}
 
-    documents_.erase(document_id);
+bool SearchServer::MarkRemoved(int document_id) {
+    const auto ordinal_it = document_ordinals_.find(document_id);
+    if (ordinal_it == document_ordinals_.end()) {
+        return false;
+    }
+    const DocumentOrdinal document_ordinal = ordinal_it->second;
+    const auto term_freqs = GetTermFreqs(documents_[document_ordinal]);
+    // Term frequencies of a loaded snapshot are not checked on loading
+    if (any_of(term_freqs.begin(), term_freqs.end(), [this](const TermFreq& term_freq) { return term_freq.term_id >= term_postings_.size(); })) {
+        throw runtime_error("Document term frequencies are corrupted");
+    }
+    for (const TermFreq& term_freq : term_freqs) {
+        unmerged_removals_.emplace_back(term_freq.term_id, document_ordinal);
+        ++term_tombstone_counts_[term_freq.term_id];
+    }
+    tombstones_[document_ordinal] = true;
+    ReleaseDocumentSlot(document_ordinal);
+    document_ordinals_.erase(ordinal_it);
     document_ids_.erase(document_id);
+    METRICS_COUNT("index.documents_removed", 1);
+    return true;
 }
 
-map<string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
-    if (documents_.count(document_id) > 0) {
-        return documents_.at(document_id).word_freq;
+void SearchServer::MergeRemovalsIfNeeded() {
+    const size_t posting_count = term_freqs_.size() - removed_term_freq_count_ + unmerged_removals_.size();
+    if (unmerged_removals_.size() >= max(MIN_MERGED_REMOVAL_COUNT, posting_count / 8)) {
+        MergeRemovals();
     }
-    else {
-        static const map<string_view, double> ret;
-        return ret;
+}
+
+void SearchServer::MergeRemovals() {
+    METRICS_TIMER("index.merge_removals");
+    // Grouped by term, so each posting list is rewritten by one task only
+    sort(unmerged_removals_.begin(), unmerged_removals_.end());
+    vector<size_t> term_starts;
+    for (size_t i = 0; i < unmerged_removals_.size(); ++i) {
+        if (i == 0 || unmerged_removals_[i].first != unmerged_removals_[i - 1].first) {
+            term_starts.push_back(i);
+        }
     }
+    term_starts.push_back(unmerged_removals_.size());
+    pool_->ParallelFor(
+        0, term_starts.size() - 1,
+        [this, &term_starts](size_t term) {
+            const TermId term_id = unmerged_removals_[term_starts[term]].first;
+            for (size_t i = term_starts[term]; i < term_starts[term + 1]; ++i) {
+                term_postings_[term_id].Remove(unmerged_removals_[i].second);
+            }
+            term_tombstone_counts_[term_id] = 0;
+        },
+        PARALLEL_TERM_GRAIN_SIZE);
+    unmerged_removals_.clear();
 }
 
-set<int>::const_iterator SearchServer::begin() const {
-    return document_ids_.begin();
+void SearchServer::ReleaseDocumentSlot(DocumentOrdinal document_ordinal) {
+    DocumentData& document_data = documents_[document_ordinal];
+    document_texts_.Release(document_data.document_text);
+    document_data.document_text = {};
+    removed_term_freq_count_ += document_data.term_freq_count;
+    document_data.term_freq_count = 0;
+    document_data.term_freq_offset = 0;
+    if (removed_term_freq_count_ * 2 < term_freqs_.size()) {
+        return;
+    }
+    // Compaction keeps the ordinal order of the ranges, the entries themselves do not change
+    vector<TermFreq> term_freqs;
+    term_freqs.reserve(term_freqs_.size() - removed_term_freq_count_);
+    for (DocumentData& document : documents_) {
+        const TermFreq* document_term_freqs = term_freqs_.data() + document.term_freq_offset;
+        document.term_freq_offset = term_freqs.size();
+        term_freqs.insert(term_freqs.end(), document_term_freqs, document_term_freqs + document.term_freq_count);
+    }
+    term_freqs_ = MappedArray<TermFreq>(move(term_freqs));
+    removed_term_freq_count_ = 0;
 }
 
-set<int>::const_iterator SearchServer::end() const {
-    return document_ids_.end();
+MappedArray<SearchServer::TermFreq> SearchServer::GetTermFreqs(const DocumentData& document_data) const {
+    return MappedArray<TermFreq>::Borrow(term_freqs_.data() + document_data.term_freq_offset, document_data.term_freq_count);
 }
 
 bool SearchServer::IsStopWord(string_view word) const {
@@ -192,17 +793,14 @@ bool SearchServer::IsValidWord(string_view word){
         });
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-    vector<string_view> words;
-    for (string_view word : SplitIntoWordsView(text)) {
-        if (!IsValidWord(word)) {
-            throw invalid_argument("Word "s + string(word) + " is invalid"s);
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+void SearchServer::SplitIntoWordsNoStop(string_view text, vector<string_view>& words) const {
+    const size_t invalid_word = TokenizeWords(text, words);
+    if (invalid_word != NO_INVALID_WORD) {
+        throw invalid_argument("Word "s + string(words[invalid_word]) + " is invalid"s);
     }
-    return words;
+    words.erase(remove_if(words.begin(), words.end(), [this](string_view word) {
+        return IsStopWord(word);
+        }), words.end());
 }
 
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
@@ -216,7 +814,7 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word, bool is_valid) const {
     if (word.empty()) {
         throw invalid_argument("Query word is empty"s);
     }
@@ -225,7 +823,7 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word) const {
         is_minus = true;
         word.remove_prefix(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+    if (word.empty() || word[0] == '-' || !is_valid) {
         throw invalid_argument("Query word "s + string(word) + " is invalid"s);
     }
 
@@ -233,21 +831,87 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word) const {
 }
 
 SearchServer::Query SearchServer::ParseQuery(std::string_view text) const {
+    METRICS_TIMER("query.parse");
+    static thread_local vector<string_view> words;
+    const size_t invalid_word = TokenizeWords(text, words);
+
     Query result;
-    for (string_view word : SplitIntoWordsView(text)) {
-        const auto query_word = ParseQueryWord(word);
+    for (size_t i = 0; i < words.size(); ++i) {
+        const auto query_word = ParseQueryWord(words[i], i != invalid_word);
         if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.insert(query_word.data);
-            }
-            else {
-                result.plus_words.insert(query_word.data);
-            }
+            auto& terms = query_word.is_minus ? result.minus_terms : result.plus_terms;
+            terms.push_back({ query_word.data, TermDictionary::NO_TERM });
+        }
+    }
+
+    // Each distinct word is looked up in the dictionary exactly once
+    for (auto* terms : { &result.plus_terms, &result.minus_terms }) {
+        sort(terms->begin(), terms->end(), [](const QueryTerm& lhs, const QueryTerm& rhs) {
+            return lhs.word < rhs.word;
+            });
+        terms->erase(
+            unique(terms->begin(), terms->end(), [](const QueryTerm& lhs, const QueryTerm& rhs) {
+                return lhs.word == rhs.word;
+                }),
+            terms->end());
+        for (QueryTerm& term : *terms) {
+            term.term_id = terms_.Find(term.word);
         }
     }
     return result;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
-}
\ No newline at end of file
+double SearchServer::ComputeTermInverseDocumentFreq(TermId term_id) const {
+    return log(GetDocumentCount() * 1.0 / GetTermDocumentCount(term_id));
+}
+
+double SearchServer::GetInverseDocumentFreq(const Query& query, size_t plus_position) const {
+    if (query.plus_inverse_document_freqs.empty()) {
+        return ComputeTermInverseDocumentFreq(query.plus_terms[plus_position].term_id);
+    }
+    return query.plus_inverse_document_freqs[plus_position];
+}
+
+QueryStatistics SearchServer::GetQueryStatistics(string_view raw_query) const {
+    const auto query = ParseQuery(raw_query);
+    QueryStatistics statistics;
+    statistics.document_count = GetDocumentCount();
+    for (const QueryTerm& term : query.plus_terms) {
+        statistics.document_frequencies.push_back(term.term_id == TermDictionary::NO_TERM ? 0 : GetTermDocumentCount(term.term_id));
+    }
+    return statistics;
+}
+
+void SearchServer::ApplyQueryStatistics(Query& query, const QueryStatistics& statistics) const {
+    if (statistics.document_frequencies.size() != query.plus_terms.size()) {
+        throw invalid_argument("Query statistics do not match the query"s);
+    }
+    query.plus_inverse_document_freqs.clear();
+    for (const size_t document_frequency : statistics.document_frequencies) {
+        // A word no document contains is not scored anyway
+        query.plus_inverse_document_freqs.push_back(document_frequency == 0 ? 0.0 : log(statistics.document_count * 1.0 / document_frequency));
+    }
+}
+
+string SearchServer::MakeResultCacheKey(const Query& query, string_view predicate_tag, size_t top_count) {
+    // Words never contain control characters, so they cannot be confused with the separators
+    string key;
+    for (const QueryTerm& term : query.plus_terms) {
+        key += term.word;
+        key += ' ';
+    }
+    key += '\x01';
+    for (const QueryTerm& term : query.minus_terms) {
+        key += term.word;
+        key += ' ';
+    }
+    key += '\x01';
+    key += predicate_tag;
+    key += '\x01';
+    key += to_string(top_count);
+    return key;
+}
+
+string SearchServer::GetStatusTag(DocumentStatus status) {
+    return "status:"s + to_string(static_cast<int>(status));
+}
@@ -6,13 +6,158 @@
 #include <algorithm>
 #include <execution>
 #include <functional>
+#include <memory>
+#include <iterator>
+#include <unordered_map>
+#include <utility>
 
 #include "document.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "posting_list.h"
+#include "term_dictionary.h"
+#include "top_k.h"
+#include "score_accumulator.h"
+#include "query_result_cache.h"
+#include "thread_pool.h"
+#include "mapped_array.h"
+#include "snapshot.h"
+#include "text_arena.h"
+#include "metrics.h"
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
+// Results of a batch of queries kept in one buffer.
+// The documents found by query i are documents[offsets[i]] up to, but not including, documents[offsets[i + 1]].
+struct BatchSearchResult {
+    std::vector<Document> documents;
+    std::vector<size_t> offsets{ 0 };
+
+    // Number of queries
+    size_t size() const {
+        return offsets.size() - 1;
+    }
+
+    std::vector<Document>::const_iterator begin() const {
+        return documents.begin();
+    }
+
+    std::vector<Document>::const_iterator end() const {
+        return documents.end();
+    }
+};
+
+// Document frequencies of the plus words of a query, in the order the server parses them: sorted by word,
+// without repeats and stop words. Servers holding parts of one corpus produce statistics that add up to those
+// of the whole corpus, and scoring every part with the sums gives the relevances of a single server.
+struct QueryStatistics {
+    int document_count = 0;
+    std::vector<size_t> document_frequencies;
+
+    QueryStatistics& operator+=(const QueryStatistics& other) {
+        document_count += other.document_count;
+        document_frequencies.resize(std::max(document_frequencies.size(), other.document_frequencies.size()));
+        for (size_t i = 0; i < other.document_frequencies.size(); ++i) {
+            document_frequencies[i] += other.document_frequencies[i];
+        }
+        return *this;
+    }
+};
+
+// Entry of the forward index: a term of a document and its frequency in the document
+struct TermFrequency {
+    TermDictionary::TermId term_id;
+    double term_freq;
+};
+
+// Non-owning view of the words of one document with their frequencies, ordered by term id.
+// It points into the server and is valid until documents are added or removed.
+class WordFrequencies {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<std::string_view, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        Iterator(const TermDictionary* terms, const TermFrequency* entry)
+            : terms_(terms)
+            , entry_(entry) {
+        }
+
+        value_type operator*() const {
+            return { terms_->GetTerm(entry_->term_id), entry_->term_freq };
+        }
+
+        Iterator& operator++() {
+            ++entry_;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            ++entry_;
+            return previous;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return entry_ == other.entry_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return entry_ != other.entry_;
+        }
+
+    private:
+        const TermDictionary* terms_;
+        const TermFrequency* entry_;
+    };
+
+    WordFrequencies() = default;
+
+    WordFrequencies(const TermDictionary* terms, const TermFrequency* first, const TermFrequency* last)
+        : terms_(terms)
+        , first_(first)
+        , last_(last) {
+    }
+
+    Iterator begin() const {
+        return { terms_, first_ };
+    }
+
+    Iterator end() const {
+        return { terms_, last_ };
+    }
+
+    size_t size() const {
+        return static_cast<size_t>(last_ - first_);
+    }
+
+    bool empty() const {
+        return first_ == last_;
+    }
+
+    // The underlying entries, for callers that work with term ids
+    const TermFrequency* GetEntries() const {
+        return first_;
+    }
+
+    // Copy ordered by word
+    std::map<std::string_view, double> ToMap() const {
+        std::map<std::string_view, double> word_freq;
+        for (const auto [word, term_freq] : *this) {
+            word_freq.emplace(word, term_freq);
+        }
+        return word_freq;
+    }
+
+private:
+    const TermDictionary* terms_ = nullptr;
+    const TermFrequency* first_ = nullptr;
+    const TermFrequency* last_ = nullptr;
+};
+
 class SearchServer {
 public:
     template <typename StringContainer>
@@ -22,45 +167,189 @@ public:
 
     explicit SearchServer(std::string_view stop_words_text);
 
+    // The copy keeps its own copy of the texts of the documents that are not in a mapped snapshot,
+    // and starts with an empty result cache of the same capacity
+    SearchServer(const SearchServer& other);
+
+    SearchServer(SearchServer&&) = default;
+
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Adds the documents in the given order with the same resulting index as consecutive AddDocument calls.
+    // Worker threads tokenize disjoint ranges of the batch into partial indexes, which are then merged in one pass.
+    // If any document is rejected, an exception is thrown and none of the batch is added.
+    void AddDocuments(const std::vector<DocumentInput>& documents);
+
+    // Batch tokenized by PrepareDocuments and not yet added
+    class PreparedDocuments {
+    public:
+        size_t size() const {
+            return documents_.size();
+        }
+
+    private:
+        friend class SearchServer;
+
+        struct TermCount {
+            uint32_t local_id;
+            uint32_t count;
+        };
+
+        // Inverted index of one range of the batch with its own term ids
+        struct PartialIndex {
+            // In the order of the first occurrence, so interning them in this order assigns the same ids as AddDocument
+            std::vector<std::string_view> terms;
+            std::unordered_map<std::string_view, uint32_t> term_ids;
+            // Indexed by local term id, ordinals are positions in the batch
+            std::vector<std::vector<PostingList::Posting>> postings;
+            // Local term ids with their counts for every document of the range, sorted by local term id
+            std::vector<std::vector<TermCount>> document_terms;
+        };
+
+        std::vector<DocumentInput> documents_;
+        // Range i of the batch is [range_begins_[i], range_begins_[i + 1])
+        std::vector<size_t> range_begins_;
+        std::vector<PartialIndex> partial_indexes_;
+        std::vector<double> inv_word_counts_;
+    };
+
+    // The tokenizing half of AddDocuments. It only reads the stop words, so it may run on other threads
+    // while the server is being changed. Throws if a word is invalid; ids are checked when the batch is added.
+    // The texts must stay alive until then.
+    PreparedDocuments PrepareDocuments(std::vector<DocumentInput> documents) const;
+
+    // The merging half of AddDocuments, rejects the whole batch if an id is invalid or taken
+    void AddPreparedDocuments(PreparedDocuments prepared);
+
+    // top_count limits the number of returned documents
+
     //неявно последовательное выполнение
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
     //явно последовательное выполнение
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, DocumentStatus status, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query) const;
 
     //явно параллельное выполнение
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentStatus status, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query) const;
 
+    // Same as the predicate overloads, but the results are kept in the result cache under predicate_tag,
+    // so equal tags must stand for predicates that select the same documents
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, std::string_view predicate_tag, DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, std::string_view predicate_tag, DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, std::string_view predicate_tag, DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Documents offset to offset + limit of the result list ranked by DocumentRelevanceGreater, which orders
+    // ties by id, so the pages of a list never overlap. There is no MAX_RESULT_DOCUMENT_COUNT cap;
+    // only the best offset + limit documents are kept while scoring. Results are not cached.
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsPage(std::string_view raw_query, DocumentPredicate document_predicate, size_t offset, size_t limit) const;
+
+    std::vector<Document> FindTopDocumentsPage(std::string_view raw_query, DocumentStatus status, size_t offset, size_t limit) const;
+
+    // Up to limit documents of the same list that follow the cursor. Only limit documents are kept while scoring,
+    // so memory does not grow with the page number, but time does: the documents ranked before the cursor
+    // still have to be scored to be told apart from the ones after it, and they do not raise the pruning
+    // threshold, so a deep page scores more documents than the first one. Documents added or removed since
+    // the cursor was made are placed by their own rank: nothing that stays in the list is skipped or returned twice.
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsAfter(std::string_view raw_query, DocumentPredicate document_predicate, const ResultCursor& cursor, size_t limit) const;
+
+    std::vector<Document> FindTopDocumentsAfter(std::string_view raw_query, DocumentStatus status, const ResultCursor& cursor, size_t limit) const;
+
+    // Statistics of this server for the query, see QueryStatistics
+    QueryStatistics GetQueryStatistics(std::string_view raw_query) const;
+
+    // Scores with the given statistics in place of the server's own. They must be collected for the same query
+    // by servers with the same stop words, otherwise std::invalid_argument is thrown. Results are not cached.
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsWithStatistics(std::string_view raw_query, const QueryStatistics& statistics,
+        DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Runs FindTopDocuments(raw_query) for every query of the batch.
+    // The queries are parsed up front and evaluated in chunks: every posting list a chunk needs is walked once
+    // for all queries of the chunk, and queries sharing their longest posting list are put into the same chunk.
+    BatchSearchResult FindTopDocumentsBatch(const std::vector<std::string>& raw_queries) const;
+
+    // Gives the server its own pool of worker_count threads for all parallel overloads.
+    // Until then the server shares the process-wide default pool.
+    void SetWorkerCount(size_t worker_count);
+
+    // Runs the parallel overloads on this pool, which may be shared with other servers
+    void SetPool(std::shared_ptr<WorkStealingPool> pool);
+
+    std::vector<WorkStealingPool::WorkerStats> GetWorkerStats() const;
+
+    // The pool of the parallel overloads, for helpers that parallelize work over the server's documents
+    WorkStealingPool& GetPool() const;
+
+    // Caches the results of status and tagged searches for up to capacity queries, 0 turns the cache off.
+    // Cached results are dropped whenever documents are added or removed.
+    void SetResultCacheCapacity(size_t capacity);
+
+    QueryResultCache::Stats GetResultCacheStats() const;
+
     int GetDocumentCount() const;
 
     std::set<int>::const_iterator begin() const;
 
     std::set<int>::const_iterator end() const;
 
+    // Removal only leaves a tombstone: the document disappears from results at once, while its postings
+    // stay until enough removals have piled up to merge them out of the posting lists in one pass,
+    // parallel by term. The merge is synchronous: the removal that brings the pending postings to the greater
+    // of 4096 and an eighth of all postings waits until every affected posting list is rewritten, which is
+    // O(postings of the affected terms), while the other removals cost O(words). Calling CompactIndex at
+    // quiet times keeps the pending postings below that threshold. ConcurrentSearchServer merges on the
+    // unpublished version, so its readers never wait for a merge. The parallel overload forwards to
+    // the sequential one: the merge runs on the pool for either policy, so there is nothing else to split.
     void RemoveDocument(const std::execution::parallel_policy&, int document_id);
 
     void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
 
     void RemoveDocument(int document_id);
 
-    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+    // Removes all the given documents with a single merge check. Unknown ids are ignored.
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Merges all pending removals out of the posting lists now, e.g. in a maintenance window
+    void CompactIndex();
+
+    // Empty for unknown ids
+    WordFrequencies GetWordFrequencies(int document_id) const;
+
+    // Compatibility wrapper that copies GetWordFrequencies into a map
+    std::map<std::string_view, double> GetWordFrequencyMap(int document_id) const;
+
+    // Writes the whole index to a versioned, checksummed binary file. The file replaces path only once it is
+    // complete, so a server loaded from path may save back to it.
+    void SaveSnapshot(const std::string& path) const;
+
+    // Maps a file written by SaveSnapshot. Postings, terms, texts and term frequencies are used in place,
+    // only per-document metadata and the id lookup are rebuilt, so nothing is tokenized again.
+    // The file must not be changed in place while the server is alive, replacing it as SaveSnapshot does is safe.
+    // The document table is checked against the sections it indexes on loading. Postings, terms and term frequencies
+    // are checked when they are read, so a malformed file throws std::runtime_error on loading or on first use.
+    static SearchServer LoadSnapshot(const std::string& path, SnapshotVerification verification = SnapshotVerification::HEADER);
 
     using MatchDocumentResult = std::tuple<std::vector<std::string_view>, DocumentStatus>;
 
@@ -75,22 +364,89 @@ public:
     MatchDocumentResult MatchDocument(std::string_view raw_query, int document_id) const;
 
 private:
+    using TermId = TermDictionary::TermId;
+
+    using TermFreq = TermFrequency;
+
     struct DocumentData {
+        int id;
         int rating;
         DocumentStatus status;
-        std::string document_text;
-        std::map<std::string_view, double> word_freq;
+        // Stored in document_texts_, or in the mapped snapshot for documents loaded from one
+        std::string_view document_text;
+        // Postings store occurrence counts, the term frequency is count * inv_word_count
+        double inv_word_count;
+        // Range of term_freqs_, sorted by term id
+        size_t term_freq_offset;
+        size_t term_freq_count;
     };
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
+    TermDictionary terms_;
+    // Indexed by term id
+    std::vector<PostingList> term_postings_;
+    // Indexed by document ordinal, slots of removed documents are left empty and never reused
+    std::vector<DocumentData> documents_;
+    TextArena document_texts_;
+    // Forward index: the entries of each document one after another in ordinal order.
+    // Ranges of removed documents are dropped once they make up half of the buffer.
+    MappedArray<TermFreq> term_freqs_;
+    size_t removed_term_freq_count_ = 0;
+    // Indexed by document ordinal, set for removed documents. Scoring skips them, as their postings
+    // may still be in the posting lists.
+    std::vector<bool> tombstones_;
+    // Postings of removed documents that are still in the posting lists
+    std::vector<std::pair<TermId, DocumentOrdinal>> unmerged_removals_;
+    // Indexed by term id, the number of unmerged_removals_ of the term
+    std::vector<uint32_t> term_tombstone_counts_;
+    std::map<int, DocumentOrdinal> document_ordinals_;
     std::set<int> document_ids_;
+    // Changes with every added or removed document, cached results of other generations are stale
+    uint64_t index_generation_ = 0;
+    std::unique_ptr<QueryResultCache> result_cache_;
+    // Runs the parallel overloads, nested parallel loops share its workers instead of adding threads
+    std::shared_ptr<WorkStealingPool> pool_ = WorkStealingPool::GetDefault();
+    // Keeps the snapshot the server was loaded from mapped, loaded arrays point into it
+    std::shared_ptr<const MappedFile> snapshot_file_;
+
+    explicit SearchServer(SnapshotReader& reader);
+
+    static std::set<std::string, std::less<>> LoadStopWords(SnapshotReader& reader);
+
+    // Frees the memory held by a removed document, the slot itself stays to keep ordinals stable
+    void ReleaseDocumentSlot(DocumentOrdinal document_ordinal);
+
+    // Throws if an id is negative, taken or repeated in the batch
+    void CheckNewDocumentIds(const std::vector<DocumentInput>& documents) const;
+
+    // AddPreparedDocuments for a batch whose ids have been checked
+    void AddCheckedDocuments(PreparedDocuments prepared);
+
+    // Tombstones the document, returns false for unknown ids
+    bool MarkRemoved(int document_id);
+
+    // Pending removals may stay in the posting lists while they are below this count
+    // or an eighth of all postings, whichever is greater
+    static constexpr size_t MIN_MERGED_REMOVAL_COUNT = 4096;
+
+    // Merges pending removals if the policy above asks for it
+    void MergeRemovalsIfNeeded();
+
+    void MergeRemovals();
+
+    // Number of live documents containing the term
+    size_t GetTermDocumentCount(TermId term_id) const {
+        return term_postings_[term_id].size() - term_tombstone_counts_[term_id];
+    }
+
+    // Borrows the range of the document from term_freqs_
+    MappedArray<TermFreq> GetTermFreqs(const DocumentData& document_data) const;
 
     bool IsStopWord(std::string_view word) const;
 
     static bool IsValidWord(std::string_view word);
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+    // Fills words with the words of text except stop words, throws if one of them is invalid
+    void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
@@ -100,23 +456,80 @@ private:
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // is_valid tells whether the word is free of control characters, the tokenizer has checked it already
+    QueryWord ParseQueryWord(std::string_view text, bool is_valid) const;
+
+    struct QueryTerm {
+        std::string_view word;
+        // NO_TERM if the word does not occur in the index
+        TermId term_id;
+    };
 
+    // Terms are sorted by word and unique
     struct Query {
-        std::set<std::string_view> plus_words;
-        std::set<std::string_view> minus_words;
+        std::vector<QueryTerm> plus_terms;
+        std::vector<QueryTerm> minus_terms;
+        // Inverse document frequencies of plus_terms given by QueryStatistics, empty if the server's own are used
+        std::vector<double> plus_inverse_document_freqs;
     };
 
     Query ParseQuery(std::string_view text) const;
 
     // Existence required
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    double ComputeTermInverseDocumentFreq(TermId term_id) const;
+
+    double GetInverseDocumentFreq(const Query& query, size_t plus_position) const;
+
+    void ApplyQueryStatistics(Query& query, const QueryStatistics& statistics) const;
+
+    static std::string MakeResultCacheKey(const Query& query, std::string_view predicate_tag, size_t top_count);
 
+    static std::string GetStatusTag(DocumentStatus status);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsForQuery(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate, size_t top_count) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsForQuery(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate, size_t top_count) const;
+
+    // Serves the query from the result cache if it is enabled and holds a result of the current generation
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsCached(const ExecutionPolicy& policy, std::string_view raw_query, std::string_view predicate_tag, DocumentPredicate document_predicate, size_t top_count) const;
+
+    using TopDocumentsSelector = TopKSelector<Document, DocumentRelevanceGreater>;
+
+    // Scores every matching document and offers it to the selector
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    void FindAllDocuments(const Query& query, DocumentPredicate document_predicate, TopDocumentsSelector& selector) const;
 
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const;
+    void FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate, TopDocumentsSelector& selector) const;
+
+    // The parallel search does not split the corpus into ranges smaller than this
+    static constexpr size_t MIN_PARALLEL_RANGE_SIZE = 1024;
+    // AddDocuments gives every task at least this many documents
+    static constexpr size_t MIN_INGESTION_RANGE_SIZE = 256;
+    // Posting list lookups and removals are cheap, a parallel task takes several terms
+    static constexpr size_t PARALLEL_TERM_GRAIN_SIZE = 4;
+
+    template <typename DocumentPredicate>
+    void ScoreDocumentRange(const Query& query, DocumentPredicate document_predicate,
+        DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal, TopDocumentsSelector& selector) const;
+
+    // Number of queries evaluated together by FindTopDocumentsBatch
+    static constexpr size_t BATCH_QUERY_CHUNK_SIZE = 128;
+    // Ordinal span scored at once by a batch chunk, keeps the accumulators of a whole chunk small
+    static constexpr size_t BATCH_ORDINAL_RANGE_SIZE = 8192;
+
+    // Finds the top documents of queries[query_indices[i]] for i < query_count and stores them in results at the same index
+    void FindTopDocumentsChunk(const std::vector<Query>& queries, const size_t* query_indices, size_t query_count,
+        std::vector<std::vector<Document>>& results) const;
+
+    // Document-at-a-time MaxScore evaluation with the same result as FindAllDocuments.
+    // Documents whose relevance upper bound cannot reach the current top are skipped without scoring.
+    // Works with any selector ranking by relevance first
+    template <typename DocumentPredicate, typename Selector>
+    void FindTopDocumentsWithPruning(const Query& query, DocumentPredicate document_predicate, Selector& selector) const;
 };
 
 template <typename StringContainer>
@@ -130,24 +543,13 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 
 //неявно последовательное выполнение
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const auto query = ParseQuery(raw_query);
-
-    auto matched_documents = FindAllDocuments(query, document_predicate);
-
-    std::sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-            return lhs.rating > rhs.rating;
-        }
-        else {
-            return lhs.relevance > rhs.relevance;
-        }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count) const {
+    return FindTopDocumentsForQuery(std::execution::seq, ParseQuery(raw_query), document_predicate, top_count);
+}
 
-    return matched_documents;
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, std::string_view predicate_tag, DocumentPredicate document_predicate, size_t top_count) const {
+    return FindTopDocumentsCached(std::execution::seq, raw_query, "predicate:" + std::string(predicate_tag), document_predicate, top_count);
 }
 
 //явно последовательное выполнение
@@ -155,99 +557,303 @@ template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(
     const std::execution::sequenced_policy&, 
     std::string_view raw_query, 
-    DocumentPredicate document_predicate) const {
-    return FindTopDocuments(raw_query, document_predicate);
+    DocumentPredicate document_predicate,
+    size_t top_count) const {
+    return FindTopDocuments(raw_query, document_predicate, top_count);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, std::string_view predicate_tag, DocumentPredicate document_predicate, size_t top_count) const {
+    return FindTopDocuments(raw_query, predicate_tag, document_predicate, top_count);
 }
 
 //явно параллельное выполнение
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const auto query = ParseQuery(raw_query);
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count) const {
+    return FindTopDocumentsForQuery(std::execution::par, ParseQuery(raw_query), document_predicate, top_count);
+}
 
-    auto matched_documents = FindAllDocuments(std::execution::par, query, document_predicate);
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, std::string_view predicate_tag, DocumentPredicate document_predicate, size_t top_count) const {
+    return FindTopDocumentsCached(std::execution::par, raw_query, "predicate:" + std::string(predicate_tag), document_predicate, top_count);
+}
 
-    std::sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-            return lhs.rating > rhs.rating;
-        }
-        else {
-            return lhs.relevance > rhs.relevance;
-        }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsForQuery(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate, size_t top_count) const {
+    // The caller's count is not trusted for the allocation, no more documents than the index holds can be found
+    TopDocumentsSelector selector(std::min(top_count, documents_.size()), DocumentRelevanceGreater{});
+    FindTopDocumentsWithPruning(query, document_predicate, selector);
+
+    METRICS_TIMER("query.select_top");
+    return selector.ExtractSorted();
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsForQuery(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate, size_t top_count) const {
+    TopDocumentsSelector selector(std::min(top_count, documents_.size()), DocumentRelevanceGreater{});
+    FindAllDocuments(std::execution::par, query, document_predicate, selector);
+    return selector.ExtractSorted();
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsPage(std::string_view raw_query, DocumentPredicate document_predicate, size_t offset, size_t limit) const {
+    const size_t document_count = documents_.size();
+    if (offset >= document_count || limit == 0) {
+        return {};
+    }
+    // No more documents than the index holds can be kept, which also guards the sum against overflow
+    TopDocumentsSelector selector(std::min(limit, document_count - offset) + offset, DocumentRelevanceGreater{});
+    FindTopDocumentsWithPruning(ParseQuery(raw_query), document_predicate, selector);
+
+    std::vector<Document> documents = selector.ExtractSorted();
+    documents.erase(documents.begin(), documents.begin() + std::min(offset, documents.size()));
+    return documents;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsAfter(std::string_view raw_query, DocumentPredicate document_predicate, const ResultCursor& cursor, size_t limit) const {
+    TopDocumentsSelector selector(std::min(limit, documents_.size()), DocumentRelevanceGreater{});
+    selector.SetBound({ cursor.document_id, cursor.relevance, cursor.rating });
+    FindTopDocumentsWithPruning(ParseQuery(raw_query), document_predicate, selector);
+
+    return selector.ExtractSorted();
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsWithStatistics(std::string_view raw_query, const QueryStatistics& statistics,
+    DocumentPredicate document_predicate, size_t top_count) const {
+    Query query = ParseQuery(raw_query);
+    ApplyQueryStatistics(query, statistics);
+    return FindTopDocumentsForQuery(std::execution::seq, query, document_predicate, top_count);
+}
+
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsCached(const ExecutionPolicy& policy, std::string_view raw_query, std::string_view predicate_tag, DocumentPredicate document_predicate, size_t top_count) const {
+    const auto query = ParseQuery(raw_query);
+    if (!result_cache_) {
+        return FindTopDocumentsForQuery(policy, query, document_predicate, top_count);
+    }
+    std::string key = MakeResultCacheKey(query, predicate_tag, top_count);
+    if (auto documents = result_cache_->Find(key, index_generation_)) {
+        return std::move(*documents);
     }
+    auto documents = FindTopDocumentsForQuery(policy, query, document_predicate, top_count);
+    result_cache_->Insert(std::move(key), index_generation_, documents);
+    return documents;
+}
 
-    return matched_documents;
+template <typename DocumentPredicate>
+void SearchServer::FindAllDocuments(const SearchServer::Query& query, DocumentPredicate document_predicate, TopDocumentsSelector& selector) const {
+    METRICS_TIMER("query.score");
+    ScoreDocumentRange(query, document_predicate, 0, static_cast<DocumentOrdinal>(documents_.size()), selector);
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const SearchServer::Query& query, DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+void SearchServer::FindAllDocuments(
+    const std::execution::parallel_policy&,
+    const SearchServer::Query& query,
+    DocumentPredicate document_predicate,
+    TopDocumentsSelector& selector) const {
+    // Every task owns a disjoint range of ordinals with its own accumulator and heap, so nothing is shared until the merge
+    const size_t document_count = documents_.size();
+    const size_t range_count = std::clamp<size_t>(document_count / MIN_PARALLEL_RANGE_SIZE, 1, pool_->GetWorkerCount());
+    std::vector<TopDocumentsSelector> range_selectors(range_count, TopDocumentsSelector(selector.GetCapacity(), DocumentRelevanceGreater{}));
+    {
+        // The range tasks exclude, score and select at the same time, so the query gets one sample for all of it
+        METRICS_TIMER("query.score");
+        pool_->ParallelFor(
+            0, range_count,
+            [this, &query, document_predicate, document_count, range_count, &range_selectors](size_t range) {
+                const auto first_ordinal = static_cast<DocumentOrdinal>(document_count * range / range_count);
+                const auto last_ordinal = static_cast<DocumentOrdinal>(document_count * (range + 1) / range_count);
+                ScoreDocumentRange(query, document_predicate, first_ordinal, last_ordinal, range_selectors[range]);
+            },
+            1);
+    }
+    METRICS_TIMER("query.select_top");
+    for (const TopDocumentsSelector& range_selector : range_selectors) {
+        selector.Merge(range_selector);
+    }
+}
+
+template <typename DocumentPredicate>
+void SearchServer::ScoreDocumentRange(
+    const SearchServer::Query& query,
+    DocumentPredicate document_predicate,
+    DocumentOrdinal first_ordinal,
+    DocumentOrdinal last_ordinal,
+    TopDocumentsSelector& selector) const {
+    // The accumulator is indexed by the ordinal offset inside the range, so a range task touches only its own slots
+    const auto document_to_relevance = ScoreAccumulatorPool::Acquire(last_ordinal - first_ordinal);
+    // Minus words go first, so excluded documents are neither checked by the predicate nor scored
+    for (const QueryTerm& term : query.minus_terms) {
+        if (term.term_id == TermDictionary::NO_TERM) {
             continue;
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+        term_postings_[term.term_id].ForEachInRange(first_ordinal, last_ordinal, [&document_to_relevance, first_ordinal](DocumentOrdinal document_ordinal, uint32_t) {
+            document_to_relevance->Exclude(document_ordinal - first_ordinal);
+            });
+    }
+    for (size_t plus_position = 0; plus_position < query.plus_terms.size(); ++plus_position) {
+        const QueryTerm& term = query.plus_terms[plus_position];
+        if (term.term_id == TermDictionary::NO_TERM) {
+            continue;
+        }
+        const double inverse_document_freq = GetInverseDocumentFreq(query, plus_position);
+        term_postings_[term.term_id].ForEachInRange(first_ordinal, last_ordinal, [&](DocumentOrdinal document_ordinal, uint32_t term_count) {
+            const DocumentOrdinal offset = document_ordinal - first_ordinal;
+            if (document_to_relevance->IsExcluded(offset) || tombstones_[document_ordinal]) {
+                return;
+            }
+            const auto& document_data = documents_[document_ordinal];
+            // The predicate runs once per document: a scored one has passed it, a rejected one is excluded
+            if (!document_to_relevance->IsScored(offset) && !document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                document_to_relevance->Exclude(offset);
+                return;
             }
+            document_to_relevance->Add(offset, term_count * document_data.inv_word_count * inverse_document_freq);
+            });
+    }
+
+    document_to_relevance->ForEachScored([this, first_ordinal, &selector](DocumentOrdinal offset, double relevance) {
+        const auto& document_data = documents_[first_ordinal + offset];
+        selector.Push({ document_data.id, relevance, document_data.rating });
+        });
+}
+
+template <typename DocumentPredicate, typename Selector>
+void SearchServer::FindTopDocumentsWithPruning(
+    const SearchServer::Query& query,
+    DocumentPredicate document_predicate,
+    Selector& selector) const {
+    if (selector.GetCapacity() == 0) {
+        return;
+    }
+
+    // Minus words go first here too: the ordinals they exclude are collected in ascending order,
+    // and the ascending candidates are looked up in them
+    std::vector<DocumentOrdinal> excluded_ordinals;
+    {
+        METRICS_TIMER("query.minus_words");
+        for (const QueryTerm& term : query.minus_terms) {
+            if (term.term_id == TermDictionary::NO_TERM) {
+                continue;
+            }
+            term_postings_[term.term_id].ForEach([&excluded_ordinals](DocumentOrdinal document_ordinal, uint32_t) {
+                excluded_ordinals.push_back(document_ordinal);
+                });
+        }
+        if (query.minus_terms.size() > 1) {
+            std::sort(excluded_ordinals.begin(), excluded_ordinals.end());
         }
     }
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    auto next_excluded = excluded_ordinals.cbegin();
+
+    METRICS_TIMER("query.score");
+
+    struct TermCursor {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+        double upper_bound;
+        size_t query_position;
+    };
+
+    std::vector<TermCursor> term_cursors;
+    for (size_t query_position = 0; query_position < query.plus_terms.size(); ++query_position) {
+        const TermId term_id = query.plus_terms[query_position].term_id;
+        if (term_id == TermDictionary::NO_TERM || GetTermDocumentCount(term_id) == 0) {
             continue;
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
-        }
+        const PostingList& postings = term_postings_[term_id];
+        const double inverse_document_freq = GetInverseDocumentFreq(query, query_position);
+        term_cursors.push_back({ PostingList::Cursor(postings), inverse_document_freq, postings.GetMaxTermFreq() * inverse_document_freq, query_position });
     }
-    
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+    std::sort(term_cursors.begin(), term_cursors.end(), [](const TermCursor& lhs, const TermCursor& rhs) {
+        return lhs.upper_bound < rhs.upper_bound;
+        });
+    // bound_prefix[i] bounds the relevance a document can get from terms 0..i
+    std::vector<double> bound_prefix(term_cursors.size());
+    double bound_sum = 0.0;
+    for (size_t i = 0; i < term_cursors.size(); ++i) {
+        bound_sum += term_cursors[i].upper_bound;
+        bound_prefix[i] = bound_sum;
     }
-    return matched_documents;
-}
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(
-    const std::execution::parallel_policy&,
-    const SearchServer::Query& query,
-    DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(90);
-    std::for_each(
-        std::execution::par,
-        query.plus_words.begin(), query.plus_words.end(),
-        [this, document_predicate, &document_to_relevance](const std::string_view word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return;
+    // A document is let into the selector when it is not clearly less relevant than the worst kept one
+    const auto can_enter = [&selector](double relevance_bound) {
+        return !selector.IsFull() || relevance_bound >= selector.GetWorst().relevance - RELEVANCE_EPSILON;
+    };
+
+    // Contributions are summed in query order at the end, so relevances match the exhaustive path bit for bit
+    std::vector<double> term_relevances(query.plus_terms.size(), 0.0);
+    // Terms before first_essential together cannot lift a document into the top, so they never produce candidates
+    size_t first_essential = 0;
+    [[maybe_unused]] size_t candidate_count = 0;
+    [[maybe_unused]] size_t pruned_count = 0;
+    while (true) {
+        while (first_essential < term_cursors.size() && !can_enter(bound_prefix[first_essential])) {
+            ++first_essential;
+        }
+        if (first_essential == term_cursors.size()) {
+            break;
+        }
+
+        bool has_candidate = false;
+        DocumentOrdinal candidate = 0;
+        for (size_t i = first_essential; i < term_cursors.size(); ++i) {
+            const PostingList::Cursor& cursor = term_cursors[i].cursor;
+            if (!cursor.IsEnd() && (!has_candidate || cursor.GetOrdinal() < candidate)) {
+                candidate = cursor.GetOrdinal();
+                has_candidate = true;
             }
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                }
+        }
+        if (!has_candidate) {
+            break;
+        }
+        ++candidate_count;
+
+        std::fill(term_relevances.begin(), term_relevances.end(), 0.0);
+        double relevance_bound = 0.0;
+        for (size_t i = first_essential; i < term_cursors.size(); ++i) {
+            TermCursor& term_cursor = term_cursors[i];
+            if (!term_cursor.cursor.IsEnd() && term_cursor.cursor.GetOrdinal() == candidate) {
+                const double term_relevance = term_cursor.cursor.GetTermCount() * documents_[candidate].inv_word_count * term_cursor.inverse_document_freq;
+                term_relevances[term_cursor.query_position] = term_relevance;
+                relevance_bound += term_relevance;
+                term_cursor.cursor.Next();
             }
-        });
-    std::for_each(
-        std::execution::par,
-        query.minus_words.begin(), query.minus_words.end(),
-        [this, &document_to_relevance](const std::string_view word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return;
+        }
+        bool is_pruned = false;
+        for (size_t i = first_essential; i-- > 0;) {
+            if (!can_enter(relevance_bound + bound_prefix[i])) {
+                is_pruned = true;
+                break;
             }
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
+            TermCursor& term_cursor = term_cursors[i];
+            term_cursor.cursor.SkipTo(candidate);
+            if (!term_cursor.cursor.IsEnd() && term_cursor.cursor.GetOrdinal() == candidate) {
+                const double term_relevance = term_cursor.cursor.GetTermCount() * documents_[candidate].inv_word_count * term_cursor.inverse_document_freq;
+                term_relevances[term_cursor.query_position] = term_relevance;
+                relevance_bound += term_relevance;
             }
-        });
+        }
+        if (is_pruned || !can_enter(relevance_bound)) {
+            ++pruned_count;
+            continue;
+        }
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+        next_excluded = std::lower_bound(next_excluded, excluded_ordinals.cend(), candidate);
+        const bool is_excluded = next_excluded != excluded_ordinals.cend() && *next_excluded == candidate;
+        const auto& document_data = documents_[candidate];
+        if (is_excluded || tombstones_[candidate] || !document_predicate(document_data.id, document_data.status, document_data.rating)) {
+            continue;
+        }
+        double relevance = 0.0;
+        for (const double term_relevance : term_relevances) {
+            relevance += term_relevance;
+        }
+        selector.Push({ document_data.id, relevance, document_data.rating });
     }
-    return matched_documents;
-}
\ No newline at end of file
+    METRICS_COUNT("query.candidates", candidate_count);
+    METRICS_COUNT("query.candidates_pruned", pruned_count);
+}
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "sharded_search_server.h"
+
+using namespace std;
+
+size_t GetDocumentShardIndex(int document_id, size_t shard_count) {
+    // Ids are often consecutive or share a stride, the bits are mixed before taking the remainder
+    uint64_t x = static_cast<uint32_t>(document_id);
+    x = (x ^ (x >> 16)) * 0x45d9f3bull;
+    x = (x ^ (x >> 16)) * 0x45d9f3bull;
+    x ^= x >> 16;
+    return static_cast<size_t>(x % shard_count);
+}
+
+vector<Document> MergeShardDocuments(const vector<vector<Document>>& shard_documents, size_t top_count) {
+    size_t result_count = 0;
+    for (const vector<Document>& documents : shard_documents) {
+        result_count += documents.size();
+    }
+    TopKSelector<Document, DocumentRelevanceGreater> selector(min(top_count, result_count), DocumentRelevanceGreater{});
+    for (const vector<Document>& documents : shard_documents) {
+        for (const Document& document : documents) {
+            selector.Push(document);
+        }
+    }
+    return selector.ExtractSorted();
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    shards_[GetShardIndex(document_id)]->AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::AddDocuments(const vector<DocumentInput>& documents) {
+    vector<vector<DocumentInput>> shard_documents(shards_.size());
+    for (const DocumentInput& document : documents) {
+        shard_documents[GetShardIndex(document.id)].push_back(document);
+    }
+    pool_->ParallelFor(0, shards_.size(), [&](size_t shard_index) {
+        if (!shard_documents[shard_index].empty()) {
+            shards_[shard_index]->AddDocuments(shard_documents[shard_index]);
+        }
+        }, 1);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    shards_[GetShardIndex(document_id)]->RemoveDocument(document_id);
+}
+
+void ShardedSearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    vector<vector<int>> shard_document_ids(shards_.size());
+    for (const int document_id : document_ids) {
+        shard_document_ids[GetShardIndex(document_id)].push_back(document_id);
+    }
+    pool_->ParallelFor(0, shards_.size(), [&](size_t shard_index) {
+        shards_[shard_index]->RemoveDocuments(shard_document_ids[shard_index]);
+        }, 1);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, size_t top_count) const {
+    return FindTopDocuments(raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
+        return document_status == status;
+        }, top_count);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+SearchServer::MatchDocumentResult ShardedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    return shards_[GetShardIndex(document_id)]->MatchDocument(raw_query, document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+    for (const auto& shard : shards_) {
+        document_count += shard->GetDocumentCount();
+    }
+    return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    return GetDocumentShardIndex(document_id, shards_.size());
+}
+
+const SearchServer& ShardedSearchServer::GetShard(size_t shard_index) const {
+    return *shards_.at(shard_index);
+}
+
+void ShardedSearchServer::SetPool(shared_ptr<WorkStealingPool> pool) {
+    pool_ = move(pool);
+}
+
+QueryStatistics ShardedSearchServer::GetQueryStatistics(string_view raw_query) const {
+    vector<QueryStatistics> shard_statistics(shards_.size());
+    pool_->ParallelFor(0, shards_.size(), [&](size_t shard_index) {
+        shard_statistics[shard_index] = shards_[shard_index]->GetQueryStatistics(raw_query);
+        }, 1);
+    QueryStatistics statistics;
+    for (const QueryStatistics& part : shard_statistics) {
+        statistics += part;
+    }
+    return statistics;
+}
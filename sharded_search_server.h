@@ -0,0 +1,82 @@
+#pragma once
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "search_server.h"
+
+// Shard of a document among shard_count shards, the same for in-process and remote shards
+size_t GetDocumentShardIndex(int document_id, size_t shard_count);
+
+// Merges the top documents of every shard into the top_count best ones, ordered by DocumentRelevanceGreater
+std::vector<Document> MergeShardDocuments(const std::vector<std::vector<Document>>& shard_documents, size_t top_count);
+
+// Splits the documents between several SearchServer shards by a hash of the document id.
+// A search runs in two rounds over all shards in parallel: the first collects QueryStatistics, the second scores
+// every shard with the statistics summed over all shards. Relevances are therefore the same as in one server
+// holding all the documents, and the top documents of the shards are merged with the same ordering.
+// Calls for one document id go to its shard only. RemoteShardedSearchServer of remote_shard.h searches shards
+// that run in processes of their own the same way.
+class ShardedSearchServer {
+public:
+    template <typename StopWords>
+    ShardedSearchServer(const StopWords& stop_words, size_t shard_count);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    // Every shard adds its part of the batch as SearchServer::AddDocuments does.
+    // If a shard rejects its part, the parts other shards have accepted stay added.
+    void AddDocuments(const std::vector<DocumentInput>& documents);
+
+    void RemoveDocument(int document_id);
+
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    SearchServer::MatchDocumentResult MatchDocument(std::string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const;
+
+    size_t GetShardIndex(int document_id) const;
+
+    const SearchServer& GetShard(size_t shard_index) const;
+
+    // Fans calls out on this pool instead of the process-wide default one
+    void SetPool(std::shared_ptr<WorkStealingPool> pool);
+
+private:
+    std::vector<std::unique_ptr<SearchServer>> shards_;
+    std::shared_ptr<WorkStealingPool> pool_ = WorkStealingPool::GetDefault();
+
+    QueryStatistics GetQueryStatistics(std::string_view raw_query) const;
+};
+
+template <typename StopWords>
+ShardedSearchServer::ShardedSearchServer(const StopWords& stop_words, size_t shard_count) {
+    if (shard_count == 0) {
+        throw std::invalid_argument("Shard count must be positive");
+    }
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(std::make_unique<SearchServer>(stop_words));
+    }
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count) const {
+    const QueryStatistics statistics = GetQueryStatistics(raw_query);
+    std::vector<std::vector<Document>> shard_documents(shards_.size());
+    pool_->ParallelFor(0, shards_.size(), [&](size_t shard_index) {
+        shard_documents[shard_index] = shards_[shard_index]->FindTopDocumentsWithStatistics(raw_query, statistics, document_predicate, top_count);
+        }, 1);
+    return MergeShardDocuments(shard_documents, top_count);
+}
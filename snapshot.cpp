@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "snapshot.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SNAPSHOT_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+// Reads back differently on a machine with the other byte order
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t payload_size;
+    uint64_t payload_checksum;
+    // Covers the fields above
+    uint64_t header_checksum;
+};
+
+static_assert(sizeof(SnapshotHeader) % SnapshotWriter::ALIGNMENT == 0);
+
+// 64-bit FNV-1a, stable across platforms and builds
+const uint64_t CHECKSUM_SEED = 14695981039346656037ull;
+
+uint64_t UpdateChecksum(uint64_t checksum, const void* data, size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        checksum = (checksum ^ bytes[i]) * 1099511628211ull;
+    }
+    return checksum;
+}
+
+uint64_t ComputeHeaderChecksum(const SnapshotHeader& header) {
+    return UpdateChecksum(CHECKSUM_SEED, &header, offsetof(SnapshotHeader, header_checksum));
+}
+
+} // namespace
+
+MappedFile::MappedFile(const string& path) {
+#ifdef SNAPSHOT_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw runtime_error("Cannot read "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("Cannot map "s + path);
+        }
+        data_ = static_cast<const char*>(data);
+        is_mapped_ = true;
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+#else
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in) {
+        throw runtime_error("Cannot open "s + path);
+    }
+    size_ = static_cast<size_t>(in.tellg());
+    buffer_ = make_unique<uint64_t[]>((size_ + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(buffer_.get()), static_cast<streamsize>(size_))) {
+        throw runtime_error("Cannot read "s + path);
+    }
+    data_ = reinterpret_cast<const char*>(buffer_.get());
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef SNAPSHOT_MMAP
+    if (is_mapped_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+const char* MappedFile::data() const {
+    return data_;
+}
+
+size_t MappedFile::size() const {
+    return size_;
+}
+
+SnapshotWriter::SnapshotWriter(const string& path)
+    : path_(path)
+    , temporary_path_(path + ".tmp"s)
+    , out_(temporary_path_, ios::binary | ios::trunc)
+    , payload_checksum_(CHECKSUM_SEED) {
+    if (!out_) {
+        throw runtime_error("Cannot create "s + temporary_path_);
+    }
+    // The header is written by Finish, when the payload is known
+    const SnapshotHeader header{};
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (!is_finished_) {
+        out_.close();
+        remove(temporary_path_.c_str());
+    }
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size) {
+    static const char padding[ALIGNMENT] = {};
+    const size_t padding_size = (ALIGNMENT - size % ALIGNMENT) % ALIGNMENT;
+    out_.write(static_cast<const char*>(data), static_cast<streamsize>(size));
+    out_.write(padding, static_cast<streamsize>(padding_size));
+    payload_checksum_ = UpdateChecksum(payload_checksum_, data, size);
+    payload_checksum_ = UpdateChecksum(payload_checksum_, padding, padding_size);
+    payload_size_ += size + padding_size;
+}
+
+void SnapshotWriter::Finish() {
+    SnapshotHeader header{};
+    copy(begin(SNAPSHOT_MAGIC), end(SNAPSHOT_MAGIC), header.magic);
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.payload_size = payload_size_;
+    header.payload_checksum = payload_checksum_;
+    header.header_checksum = ComputeHeaderChecksum(header);
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.close();
+    if (!out_) {
+        throw runtime_error("Cannot write "s + temporary_path_);
+    }
+#ifdef SNAPSHOT_MMAP
+    // The data has to reach the disk before the rename does, or a crash could leave an empty file at path
+    const int fd = open(temporary_path_.c_str(), O_RDONLY);
+    const bool is_synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!is_synced) {
+        throw runtime_error("Cannot write "s + temporary_path_);
+    }
+#endif
+    // A server that mapped the old file keeps reading it, the rename only unlinks its name
+    if (rename(temporary_path_.c_str(), path_.c_str()) != 0) {
+        throw runtime_error("Cannot replace "s + path_);
+    }
+    is_finished_ = true;
+}
+
+SnapshotReader::SnapshotReader(shared_ptr<const MappedFile> file, SnapshotVerification verification)
+    : file_(move(file))
+    , position_(sizeof(SnapshotHeader)) {
+    SnapshotHeader header;
+    if (file_->size() < sizeof(header)) {
+        throw runtime_error("Snapshot is corrupted");
+    }
+    memcpy(&header, file_->data(), sizeof(header));
+    if (!equal(begin(SNAPSHOT_MAGIC), end(SNAPSHOT_MAGIC), header.magic) || header.header_checksum != ComputeHeaderChecksum(header)) {
+        throw runtime_error("Not a snapshot or the snapshot is corrupted");
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw runtime_error("Unsupported snapshot version "s + to_string(header.version));
+    }
+    if (header.byte_order != SNAPSHOT_BYTE_ORDER) {
+        throw runtime_error("Snapshot was written on a machine with another byte order");
+    }
+    if (header.payload_size != file_->size() - sizeof(header)) {
+        throw runtime_error("Snapshot is truncated");
+    }
+    if (verification == SnapshotVerification::FULL
+        && UpdateChecksum(CHECKSUM_SEED, file_->data() + sizeof(header), header.payload_size) != header.payload_checksum) {
+        throw runtime_error("Snapshot checksum mismatch");
+    }
+}
+
+const char* SnapshotReader::ReadBytes(size_t size) {
+    const size_t padded_size = size + (SnapshotWriter::ALIGNMENT - size % SnapshotWriter::ALIGNMENT) % SnapshotWriter::ALIGNMENT;
+    if (padded_size > file_->size() - position_) {
+        throw runtime_error("Snapshot is corrupted");
+    }
+    const char* data = file_->data() + position_;
+    position_ += padded_size;
+    return data;
+}
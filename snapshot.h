@@ -0,0 +1,143 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "mapped_array.h"
+
+// Binary snapshot layout: a fixed header followed by the payload, a sequence of values and arrays.
+// Every value and every array starts at an 8-byte boundary of the file, so a reader can use arrays
+// in place once the file is mapped. Integers are stored in the byte order of the writing machine,
+// which the header records; a snapshot is only loaded on a machine with the same byte order.
+
+// Incremented on every incompatible change of the layout
+const uint32_t SNAPSHOT_VERSION = 1;
+
+enum class SnapshotVerification {
+    // Only the header is checked. Loading sets up the terms and the documents but leaves the posting blocks,
+    // texts and term frequencies in the file until they are used. Damaged ones throw std::runtime_error then.
+    HEADER,
+    // The checksum of the whole payload is checked as well, which reads the entire file
+    FULL,
+};
+
+// Read-only view of a whole file. The file is memory-mapped where the platform allows it and read into memory otherwise.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const char* data() const;
+
+    size_t size() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    // Used when the file cannot be mapped, words keep the contents 8-byte aligned
+    std::unique_ptr<uint64_t[]> buffer_;
+    bool is_mapped_ = false;
+};
+
+// Writes to path + ".tmp" and renames it over path in Finish, so neither a crash nor a server still mapping
+// the old file ever sees a partly written snapshot. A writer dropped before Finish removes its temporary file.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    ~SnapshotWriter();
+
+    template <typename T>
+    void WriteValue(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        WriteBytes(&value, sizeof(T));
+    }
+
+    // Writes the element count followed by the elements
+    template <typename T>
+    void WriteArray(const T* values, size_t count) {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= ALIGNMENT);
+        WriteValue(static_cast<uint64_t>(count));
+        WriteBytes(values, count * sizeof(T));
+    }
+
+    template <typename Container>
+    void WriteArray(const Container& values) {
+        WriteArray(values.data(), values.size());
+    }
+
+    void WriteString(std::string_view str) {
+        WriteArray(str.data(), str.size());
+    }
+
+    // Completes the header, flushes the file to disk and replaces path with it. Nothing can be written afterwards.
+    void Finish();
+
+    static constexpr size_t ALIGNMENT = 8;
+
+private:
+    std::string path_;
+    std::string temporary_path_;
+    std::ofstream out_;
+    bool is_finished_ = false;
+    uint64_t payload_size_ = 0;
+    uint64_t payload_checksum_;
+
+    // Pads the data to the alignment
+    void WriteBytes(const void* data, size_t size);
+};
+
+class SnapshotReader {
+public:
+    // Throws std::runtime_error if the file is not a snapshot of this version or fails the verification
+    SnapshotReader(std::shared_ptr<const MappedFile> file, SnapshotVerification verification);
+
+    template <typename T>
+    T ReadValue() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, ReadBytes(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    // The array points into the file and stays valid while the file is alive
+    template <typename T>
+    MappedArray<T> ReadArray() {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= SnapshotWriter::ALIGNMENT);
+        const auto count = ReadValue<uint64_t>();
+        if (count > (file_->size() - position_) / sizeof(T)) {
+            throw std::runtime_error("Snapshot is corrupted");
+        }
+        return MappedArray<T>::Borrow(reinterpret_cast<const T*>(ReadBytes(count * sizeof(T))), count);
+    }
+
+    std::string_view ReadString() {
+        const MappedArray<char> chars = ReadArray<char>();
+        return { chars.data(), chars.size() };
+    }
+
+    const std::shared_ptr<const MappedFile>& GetFile() const {
+        return file_;
+    }
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    size_t position_;
+
+    const char* ReadBytes(size_t size);
+};
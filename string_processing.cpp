@@ -1,7 +1,154 @@
+#include <cstdint>
+
 #include "string_processing.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TOKENIZER_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 code is compiled with a function target attribute and only called after a CPU check
+#if defined(TOKENIZER_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TOKENIZER_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 using namespace std;
 
+namespace {
+
+uint32_t CountTrailingZeros(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+uint32_t CountBits(uint32_t mask) {
+#ifdef _MSC_VER
+    return __popcnt(mask);
+#else
+    return __builtin_popcount(mask);
+#endif
+}
+
+bool IsControlChar(char c) {
+    return static_cast<unsigned char>(c) < ' ';
+}
+
+// Collects words of one string from separator and control character bitmasks of consecutive chunks
+class WordSplitter {
+public:
+    WordSplitter(string_view str, vector<string_view>& words)
+        : str_(str)
+        , words_(words)
+    {
+        words_.clear();
+    }
+
+    // Bit i of the masks describes str[offset + i]
+    void ConsumeMasks(size_t offset, uint32_t space_mask, uint32_t control_mask) {
+        if (control_mask != 0 && first_invalid_word_ == NO_INVALID_WORD) {
+            const uint32_t first_control = CountTrailingZeros(control_mask);
+            first_invalid_word_ = words_.size() + CountBits(space_mask & ((uint32_t{ 1 } << first_control) - 1));
+        }
+        for (; space_mask != 0; space_mask &= space_mask - 1) {
+            PushWord(offset + CountTrailingZeros(space_mask));
+        }
+    }
+
+    void ConsumeChar(size_t pos) {
+        if (str_[pos] == ' ') {
+            PushWord(pos);
+        }
+        else if (IsControlChar(str_[pos]) && first_invalid_word_ == NO_INVALID_WORD) {
+            first_invalid_word_ = words_.size();
+        }
+    }
+
+    size_t Finish() {
+        words_.push_back(str_.substr(word_begin_));
+        return first_invalid_word_;
+    }
+
+private:
+    string_view str_;
+    vector<string_view>& words_;
+    size_t word_begin_ = 0;
+    size_t first_invalid_word_ = NO_INVALID_WORD;
+
+    void PushWord(size_t space_pos) {
+        words_.push_back(str_.substr(word_begin_, space_pos - word_begin_));
+        word_begin_ = space_pos + 1;
+    }
+};
+
+#ifdef TOKENIZER_SSE2
+size_t TokenizeWordsSse2(string_view str, vector<string_view>& words) {
+    WordSplitter splitter(str, words);
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i last_control = _mm_set1_epi8(' ' - 1);
+    size_t pos = 0;
+    for (; pos + sizeof(__m128i) <= str.size(); pos += sizeof(__m128i)) {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + pos));
+        // Unsigned chars <= 31 are left unchanged by the minimum
+        const __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(chars, last_control), chars);
+        splitter.ConsumeMasks(pos,
+            static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, spaces))),
+            static_cast<uint32_t>(_mm_movemask_epi8(controls)));
+    }
+    for (; pos < str.size(); ++pos) {
+        splitter.ConsumeChar(pos);
+    }
+    return splitter.Finish();
+}
+#endif
+
+#ifdef TOKENIZER_AVX2
+__attribute__((target("avx2")))
+size_t TokenizeWordsAvx2(string_view str, vector<string_view>& words) {
+    WordSplitter splitter(str, words);
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i last_control = _mm256_set1_epi8(' ' - 1);
+    size_t pos = 0;
+    for (; pos + sizeof(__m256i) <= str.size(); pos += sizeof(__m256i)) {
+        const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str.data() + pos));
+        const __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(chars, last_control), chars);
+        splitter.ConsumeMasks(pos,
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, spaces))),
+            static_cast<uint32_t>(_mm256_movemask_epi8(controls)));
+    }
+    for (; pos < str.size(); ++pos) {
+        splitter.ConsumeChar(pos);
+    }
+    return splitter.Finish();
+}
+#endif
+
+using TokenizeFunction = size_t (*)(string_view, vector<string_view>&);
+
+TokenizeFunction SelectTokenizer() {
+#ifdef TOKENIZER_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return TokenizeWordsAvx2;
+    }
+#endif
+#ifdef TOKENIZER_SSE2
+    return TokenizeWordsSse2;
+#else
+    return TokenizeWordsScalar;
+#endif
+}
+
+} // namespace
+
 vector<string> SplitIntoWords(const string& text) {
     vector<string> words;
     string word;
@@ -24,16 +171,19 @@ vector<string> SplitIntoWords(const string& text) {
 
 vector<string_view> SplitIntoWordsView(string_view str) {
     vector<string_view> result;
-    const int64_t pos_end = str.npos;
-    while (true) {
-        int64_t space = str.find(' ');
-        result.push_back(space == pos_end ? str.substr(0) : str.substr(0, space));
-        if (space == pos_end) {
-            break;
-        }
-        else {
-            str.remove_prefix(space + 1);
-        }
-    }
+    TokenizeWords(str, result);
     return result;
-}
\ No newline at end of file
+}
+
+size_t TokenizeWords(string_view str, vector<string_view>& words) {
+    static const TokenizeFunction tokenize = SelectTokenizer();
+    return tokenize(str, words);
+}
+
+size_t TokenizeWordsScalar(string_view str, vector<string_view>& words) {
+    WordSplitter splitter(str, words);
+    for (size_t pos = 0; pos < str.size(); ++pos) {
+        splitter.ConsumeChar(pos);
+    }
+    return splitter.Finish();
+}
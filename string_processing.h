@@ -3,11 +3,23 @@
 #include <vector>
 #include <string>
 #include <functional>
+#include <string_view>
 
 std::vector<std::string> SplitIntoWords(const std::string& text);
 
 std::vector<std::string_view> SplitIntoWordsView(std::string_view str);
 
+// Returned by TokenizeWords when no word contains a control character
+const size_t NO_INVALID_WORD = static_cast<size_t>(-1);
+
+// Splits str into words exactly like SplitIntoWordsView, but into the caller's buffer (its contents are replaced,
+// its capacity is reused), and looks for control characters (codes 0-31) in the same pass.
+// Returns the index of the first word containing one, or NO_INVALID_WORD.
+// Uses AVX2 or SSE2 depending on the CPU the program runs on.
+size_t TokenizeWords(std::string_view str, std::vector<std::string_view>& words);
+
+size_t TokenizeWordsScalar(std::string_view str, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
@@ -0,0 +1,144 @@
+#include <stdexcept>
+
+#include "term_dictionary.h"
+
+using namespace std;
+
+namespace {
+
+// 64-bit FNV-1a. The hash table is saved in snapshots, so the hash must not depend on the platform or the build.
+uint64_t HashTerm(string_view term) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c : term) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+} // namespace
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+    : mapped_chars_(other.mapped_chars_)
+    , mapped_offsets_(other.mapped_offsets_)
+    , mapped_slots_(other.mapped_slots_)
+    , mapped_term_count_(other.mapped_term_count_)
+    , terms_(other.terms_) {
+    term_to_id_.reserve(terms_.size());
+    for (size_t i = 0; i < terms_.size(); ++i) {
+        term_to_id_.emplace(terms_[i], static_cast<TermId>(mapped_term_count_ + i));
+    }
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+    if (this != &other) {
+        TermDictionary copy(other);
+        *this = move(copy);
+    }
+    return *this;
+}
+
+TermDictionary::TermId TermDictionary::Intern(string_view term) {
+    const TermId mapped_term_id = FindMapped(term);
+    if (mapped_term_id != NO_TERM) {
+        return mapped_term_id;
+    }
+    const auto it = term_to_id_.find(term);
+    if (it != term_to_id_.end()) {
+        return it->second;
+    }
+    const TermId term_id = static_cast<TermId>(size());
+    const string& stored_term = terms_.emplace_back(term);
+    term_to_id_.emplace(stored_term, term_id);
+    return term_id;
+}
+
+TermDictionary::TermId TermDictionary::Find(string_view term) const {
+    const TermId mapped_term_id = FindMapped(term);
+    if (mapped_term_id != NO_TERM) {
+        return mapped_term_id;
+    }
+    const auto it = term_to_id_.find(term);
+    return it == term_to_id_.end() ? NO_TERM : it->second;
+}
+
+string_view TermDictionary::GetTerm(TermId term_id) const {
+    if (term_id < mapped_term_count_) {
+        // Loading does not walk the offsets, so they are checked on use
+        const uint64_t first = mapped_offsets_[term_id];
+        const uint64_t last = mapped_offsets_[term_id + 1];
+        if (first > last || last > mapped_chars_.size()) {
+            throw runtime_error("Term dictionary is corrupted");
+        }
+        return { mapped_chars_.data() + first, last - first };
+    }
+    if (term_id - mapped_term_count_ >= terms_.size()) {
+        throw runtime_error("Term id is out of range");
+    }
+    return terms_[term_id - mapped_term_count_];
+}
+
+size_t TermDictionary::size() const {
+    return mapped_term_count_ + terms_.size();
+}
+
+void TermDictionary::Save(SnapshotWriter& writer) const {
+    string chars;
+    vector<uint64_t> offsets{ 0 };
+    offsets.reserve(size() + 1);
+    // At most half full, so probe sequences stay short
+    size_t slot_count = 1;
+    while (slot_count < size() * 2) {
+        slot_count *= 2;
+    }
+    vector<TermId> slots(slot_count, NO_TERM);
+    for (TermId term_id = 0; term_id < size(); ++term_id) {
+        const string_view term = GetTerm(term_id);
+        chars += term;
+        offsets.push_back(chars.size());
+        size_t slot = HashTerm(term) & (slot_count - 1);
+        while (slots[slot] != NO_TERM) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = term_id;
+    }
+    writer.WriteString(chars);
+    writer.WriteArray(offsets);
+    writer.WriteArray(slots);
+}
+
+TermDictionary TermDictionary::Load(SnapshotReader& reader) {
+    TermDictionary dictionary;
+    dictionary.mapped_chars_ = reader.ReadArray<char>();
+    dictionary.mapped_offsets_ = reader.ReadArray<uint64_t>();
+    dictionary.mapped_slots_ = reader.ReadArray<TermId>();
+    const size_t slot_count = dictionary.mapped_slots_.size();
+    // A full table would make the probing of a missing term endless
+    // Only the sizes are checked here, so loading does not depend on the number of terms;
+    // GetTerm and FindMapped check the offsets and slots they read
+    if (dictionary.mapped_offsets_.empty() || slot_count < dictionary.mapped_offsets_.size() || (slot_count & (slot_count - 1)) != 0
+        || dictionary.mapped_offsets_.front() != 0 || dictionary.mapped_offsets_.back() != dictionary.mapped_chars_.size()) {
+        throw runtime_error("Snapshot is corrupted");
+    }
+    dictionary.mapped_term_count_ = dictionary.mapped_offsets_.size() - 1;
+    return dictionary;
+}
+
+TermDictionary::TermId TermDictionary::FindMapped(string_view term) const {
+    if (mapped_slots_.empty()) {
+        return NO_TERM;
+    }
+    const size_t slot_mask = mapped_slots_.size() - 1;
+    size_t slot = HashTerm(term) & slot_mask;
+    // A table saved by Save always has free slots, a damaged one must not make the probing endless
+    for (size_t probe_count = 0; probe_count < mapped_slots_.size() && mapped_slots_[slot] != NO_TERM; ++probe_count) {
+        const TermId term_id = mapped_slots_[slot];
+        if (term_id >= mapped_term_count_) {
+            throw runtime_error("Term dictionary is corrupted");
+        }
+        if (GetTerm(term_id) == term) {
+            return term_id;
+        }
+        slot = (slot + 1) & slot_mask;
+    }
+    return NO_TERM;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "mapped_array.h"
+#include "snapshot.h"
+
+// Interns terms and maps them to dense ids 0, 1, 2, ...
+// Term strings never move, so views returned by GetTerm stay valid for the dictionary lifetime.
+// A dictionary loaded from a snapshot looks its terms up in the saved hash table in place;
+// terms interned later are kept apart and get the ids that follow.
+class TermDictionary {
+public:
+    using TermId = uint32_t;
+
+    static constexpr TermId NO_TERM = std::numeric_limits<TermId>::max();
+
+    TermDictionary() = default;
+
+    TermDictionary(const TermDictionary& other);
+
+    TermDictionary& operator=(const TermDictionary& other);
+
+    TermDictionary(TermDictionary&&) = default;
+
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    // Returns the id of the term, adding it on first sight
+    TermId Intern(std::string_view term);
+
+    // Returns NO_TERM for unknown terms
+    TermId Find(std::string_view term) const;
+
+    // Throws std::runtime_error for an id the dictionary does not hold or a damaged loaded term
+    std::string_view GetTerm(TermId term_id) const;
+
+    size_t size() const;
+
+    void Save(SnapshotWriter& writer) const;
+
+    static TermDictionary Load(SnapshotReader& reader);
+
+private:
+    // Characters of the loaded terms one after another, term i takes [mapped_offsets_[i], mapped_offsets_[i + 1])
+    MappedArray<char> mapped_chars_;
+    MappedArray<uint64_t> mapped_offsets_;
+    // Open-addressing table of loaded term ids with linear probing, its size is a power of two
+    MappedArray<TermId> mapped_slots_;
+    size_t mapped_term_count_ = 0;
+
+    std::deque<std::string> terms_;
+    std::unordered_map<std::string_view, TermId> term_to_id_;
+
+    TermId FindMapped(std::string_view term) const;
+};
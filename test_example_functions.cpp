@@ -1,7 +1,27 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 
 #include "test_example_functions.h"
+#include "concurrent_search_server.h"
+#include "ingestion_pipeline.h"
 #include "log_duration.h"
+#include "process_queries.h"
+#include "query_protocol.h"
+#include "remote_shard.h"
+#include "sharded_search_server.h"
+#include "string_processing.h"
 
 using namespace std;
 
@@ -58,4 +78,658 @@ void MatchDocuments(const SearchServer& search_server, const string& query) {
     catch (const invalid_argument& e) {
         cout << "Ошибка матчинга документов на запрос "s << query << ": "s << e.what() << endl;
     }
-}
\ No newline at end of file
+}
+
+namespace {
+
+struct ExampleDocument {
+    int id;
+    string text;
+    DocumentStatus status;
+    vector<int> ratings;
+    // Of the words that are not stop words
+    map<string, double> term_freqs;
+};
+
+const string EXAMPLE_STOP_WORDS = "and with"s;
+
+map<string, double> ComputeExampleTermFreqs(const string& text) {
+    const auto stop_words = MakeUniqueNonEmptyStrings(SplitIntoWords(EXAMPLE_STOP_WORDS));
+    vector<string> words;
+    for (const string& word : SplitIntoWords(text)) {
+        if (stop_words.count(word) == 0) {
+            words.push_back(word);
+        }
+    }
+    map<string, double> term_freqs;
+    for (const string& word : words) {
+        term_freqs[word] += 1.0 / words.size();
+    }
+    return term_freqs;
+}
+
+// The documents of the demo followed by generated ones, enough for posting lists of several blocks,
+// several parallel ranges and many relevance and rating ties
+vector<ExampleDocument> MakeExampleDocuments() {
+    vector<ExampleDocument> documents = {
+        { 1, "white cat and yellow hat"s, DocumentStatus::ACTUAL, { 1, 2 }, {} },
+        { 2, "curly cat curly tail"s, DocumentStatus::ACTUAL, { 1, 2 }, {} },
+        { 3, "nasty dog with big eyes"s, DocumentStatus::ACTUAL, { 1, 2 }, {} },
+        { 4, "nasty pigeon john"s, DocumentStatus::ACTUAL, { 1, 2 }, {} },
+    };
+    const vector<string> words = { "white"s, "cat"s, "and"s, "yellow"s, "hat"s, "curly"s, "tail"s, "nasty"s, "dog"s,
+        "with"s, "big"s, "eyes"s, "pigeon"s, "john"s };
+    for (int id = 5; id <= 3000; ++id) {
+        string text;
+        for (int position = 0; position <= id % 5; ++position) {
+            if (!text.empty()) {
+                text += ' ';
+            }
+            text += words[(id * (position + 3) + position * 7) % words.size()];
+        }
+        const DocumentStatus status = id % 7 == 0 ? DocumentStatus::BANNED
+            : id % 11 == 0 ? DocumentStatus::IRRELEVANT
+            : DocumentStatus::ACTUAL;
+        documents.push_back({ id, move(text), status, { id % 5, id % 3 - 1 }, {} });
+    }
+    for (ExampleDocument& document : documents) {
+        document.term_freqs = ComputeExampleTermFreqs(document.text);
+    }
+    return documents;
+}
+
+struct ExampleQuery {
+    set<string> plus_words;
+    set<string> minus_words;
+};
+
+ExampleQuery ParseExampleQuery(const string& raw_query) {
+    const auto stop_words = MakeUniqueNonEmptyStrings(SplitIntoWords(EXAMPLE_STOP_WORDS));
+    ExampleQuery query;
+    for (const string& word : SplitIntoWords(raw_query)) {
+        const bool is_minus = word[0] == '-';
+        const string data = is_minus ? word.substr(1) : word;
+        if (stop_words.count(data) == 0) {
+            (is_minus ? query.minus_words : query.plus_words).insert(data);
+        }
+    }
+    return query;
+}
+
+// The search as the server did it before it had an inverted index: TF-IDF summed over the plus words
+// of every document without a minus word, the most relevant first, then the higher rating, then the lower id
+template <typename DocumentPredicate>
+vector<Document> FindExampleTopDocuments(const vector<ExampleDocument>& documents, const string& raw_query,
+    DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) {
+    const ExampleQuery query = ParseExampleQuery(raw_query);
+    map<string, int> document_freqs;
+    for (const ExampleDocument& document : documents) {
+        for (const auto& [word, term_freq] : document.term_freqs) {
+            ++document_freqs[word];
+        }
+    }
+    vector<Document> result;
+    for (const ExampleDocument& document : documents) {
+        const int rating = document.ratings.empty() ? 0
+            : accumulate(document.ratings.begin(), document.ratings.end(), 0) / static_cast<int>(document.ratings.size());
+        if (!document_predicate(document.id, document.status, rating)) {
+            continue;
+        }
+        const bool is_excluded = any_of(query.minus_words.begin(), query.minus_words.end(), [&](const string& word) {
+            return document.term_freqs.count(word) > 0;
+            });
+        double relevance = 0.0;
+        bool is_matched = false;
+        for (const string& word : query.plus_words) {
+            const auto it = document.term_freqs.find(word);
+            if (it != document.term_freqs.end()) {
+                relevance += it->second * log(documents.size() * 1.0 / document_freqs.at(word));
+                is_matched = true;
+            }
+        }
+        if (is_matched && !is_excluded) {
+            result.push_back({ document.id, relevance, rating });
+        }
+    }
+    sort(result.begin(), result.end(), [](const Document& lhs, const Document& rhs) {
+        if (abs(lhs.relevance - rhs.relevance) < RELEVANCE_EPSILON) {
+            return make_pair(lhs.rating, -lhs.id) > make_pair(rhs.rating, -rhs.id);
+        }
+        return lhs.relevance > rhs.relevance;
+        });
+    if (result.size() > top_count) {
+        result.resize(top_count);
+    }
+    return result;
+}
+
+vector<string> MatchExampleDocument(const ExampleDocument& document, const string& raw_query) {
+    const ExampleQuery query = ParseExampleQuery(raw_query);
+    vector<string> words;
+    for (const string& word : query.minus_words) {
+        if (document.term_freqs.count(word) > 0) {
+            return words;
+        }
+    }
+    for (const string& word : query.plus_words) {
+        if (document.term_freqs.count(word) > 0) {
+            words.push_back(word);
+        }
+    }
+    return words;
+}
+
+bool IsSameDocuments(const vector<Document>& expected, const vector<Document>& actual) {
+    return equal(expected.begin(), expected.end(), actual.begin(), actual.end(), [](const Document& lhs, const Document& rhs) {
+        return lhs.id == rhs.id && lhs.rating == rhs.rating && abs(lhs.relevance - rhs.relevance) < RELEVANCE_EPSILON;
+        });
+}
+
+void CheckSameDocuments(const vector<Document>& expected, const vector<Document>& actual, const string& path, const string& raw_query) {
+    if (!IsSameDocuments(expected, actual)) {
+        throw logic_error(path + " returned other documents for \""s + raw_query + "\""s);
+    }
+}
+
+const char* GetExampleStatusName(DocumentStatus status) {
+    switch (status) {
+    case DocumentStatus::ACTUAL:
+        return "ACTUAL";
+    case DocumentStatus::IRRELEVANT:
+        return "IRRELEVANT";
+    case DocumentStatus::BANNED:
+        return "BANNED";
+    default:
+        return "REMOVED";
+    }
+}
+
+const vector<string> EXAMPLE_QUERIES = {
+    "curly nasty cat"s, "curly -cat"s, "nasty dog -eyes"s, "white hat tail -john -pigeon"s, "pigeon"s,
+    "and with"s, "unknown words"s, "cat dog curly nasty tail hat eyes"s, "cat cat -dog"s,
+};
+
+// Cursor pages put together and an offset page are cut from the full ranked list
+void CheckPagination(const SearchServer& search_server, const vector<ExampleDocument>& documents, const string& stage) {
+    const auto is_actual = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::ACTUAL;
+    };
+    for (const string& raw_query : EXAMPLE_QUERIES) {
+        const vector<Document> expected_all = FindExampleTopDocuments(documents, raw_query, is_actual, documents.size());
+        vector<Document> pages;
+        for (const vector<Document>& page : PaginateSearch(search_server, raw_query, 7)) {
+            pages.insert(pages.end(), page.begin(), page.end());
+        }
+        CheckSameDocuments(expected_all, pages, stage + ": FindTopDocumentsAfter"s, raw_query);
+        const vector<Document> expected_page(expected_all.begin() + min<size_t>(expected_all.size(), 6),
+            expected_all.begin() + min<size_t>(expected_all.size(), 15));
+        CheckSameDocuments(expected_page, search_server.FindTopDocumentsPage(raw_query, DocumentStatus::ACTUAL, 6, 9),
+            stage + ": FindTopDocumentsPage"s, raw_query);
+    }
+}
+
+// Every query of a batch gets the results it gets alone
+void CheckBatchSearch(const SearchServer& search_server, const vector<ExampleDocument>& documents, const string& stage) {
+    const auto is_actual = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::ACTUAL;
+    };
+    const BatchSearchResult batch = search_server.FindTopDocumentsBatch(EXAMPLE_QUERIES);
+    const vector<vector<Document>> processed = ProcessQueries(search_server, EXAMPLE_QUERIES);
+    for (size_t i = 0; i < EXAMPLE_QUERIES.size(); ++i) {
+        const vector<Document> expected = FindExampleTopDocuments(documents, EXAMPLE_QUERIES[i], is_actual);
+        CheckSameDocuments(expected, { batch.documents.begin() + batch.offsets[i], batch.documents.begin() + batch.offsets[i + 1] },
+            stage + ": FindTopDocumentsBatch"s, EXAMPLE_QUERIES[i]);
+        CheckSameDocuments(expected, processed[i], stage + ": ProcessQueries"s, EXAMPLE_QUERIES[i]);
+    }
+}
+
+// Repeated queries are answered from the cache of a copy of the server, a removal makes them searched again
+void CheckResultCache(const SearchServer& search_server, vector<ExampleDocument> documents, const string& stage) {
+    const auto is_banned = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::BANNED;
+    };
+    SearchServer cached_server(search_server);
+    cached_server.SetResultCacheCapacity(EXAMPLE_QUERIES.size() * QueryResultCache::DEFAULT_SHARD_COUNT);
+    for (int pass = 0; pass < 2; ++pass) {
+        for (const string& raw_query : EXAMPLE_QUERIES) {
+            CheckSameDocuments(FindExampleTopDocuments(documents, raw_query, is_banned),
+                cached_server.FindTopDocuments(raw_query, DocumentStatus::BANNED), stage + ": cached FindTopDocuments"s, raw_query);
+        }
+    }
+    if (cached_server.GetResultCacheStats().hits != EXAMPLE_QUERIES.size()) {
+        throw logic_error(stage + ": repeated queries were not answered from the result cache"s);
+    }
+
+    const vector<Document> cached = cached_server.FindTopDocuments(EXAMPLE_QUERIES.front(), DocumentStatus::BANNED);
+    if (cached.empty()) {
+        throw logic_error(stage + ": the corpus has no BANNED document to remove from cached results"s);
+    }
+    const int removed_id = cached.front().id;
+    cached_server.RemoveDocument(removed_id);
+    documents.erase(find_if(documents.begin(), documents.end(), [removed_id](const ExampleDocument& document) {
+        return document.id == removed_id;
+        }));
+    for (const string& raw_query : EXAMPLE_QUERIES) {
+        CheckSameDocuments(FindExampleTopDocuments(documents, raw_query, is_banned),
+            cached_server.FindTopDocuments(raw_query, DocumentStatus::BANNED), stage + ": cached FindTopDocuments after a removal"s, raw_query);
+    }
+}
+
+// Compares the searches of a server holding the documents with the straightforward search.
+// Every stage of TestSearchServer runs it, the posting lists and the scoring paths are only checked here.
+void CheckSearchPaths(const SearchServer& search_server, const vector<ExampleDocument>& documents, const string& stage) {
+    const auto is_actual = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::ACTUAL;
+    };
+    const auto is_banned = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::BANNED;
+    };
+    const auto is_even = [](int document_id, DocumentStatus, int) {
+        return document_id % 2 == 0;
+    };
+    for (const string& raw_query : EXAMPLE_QUERIES) {
+        const vector<Document> expected = FindExampleTopDocuments(documents, raw_query, is_actual);
+        CheckSameDocuments(expected, search_server.FindTopDocuments(raw_query), stage + ": FindTopDocuments"s, raw_query);
+        CheckSameDocuments(expected, search_server.FindTopDocuments(execution::par, raw_query), stage + ": parallel FindTopDocuments"s, raw_query);
+        CheckSameDocuments(FindExampleTopDocuments(documents, raw_query, is_banned),
+            search_server.FindTopDocuments(execution::par, raw_query, DocumentStatus::BANNED), stage + ": FindTopDocuments by status"s, raw_query);
+        const vector<Document> expected_even = FindExampleTopDocuments(documents, raw_query, is_even);
+        CheckSameDocuments(expected_even, search_server.FindTopDocuments(raw_query, is_even), stage + ": FindTopDocuments by predicate"s, raw_query);
+        CheckSameDocuments(expected_even, search_server.FindTopDocuments(execution::par, raw_query, is_even),
+            stage + ": parallel FindTopDocuments by predicate"s, raw_query);
+
+        for (const int document_id : { 1, 3, 4, 40, 41, 2999 }) {
+            const auto document = find_if(documents.begin(), documents.end(), [document_id](const ExampleDocument& document) {
+                return document.id == document_id;
+                });
+            if (document == documents.end()) {
+                continue;
+            }
+            const auto [words, status] = search_server.MatchDocument(raw_query, document_id);
+            const vector<string> expected_words = MatchExampleDocument(*document, raw_query);
+            if (status != document->status || !equal(words.begin(), words.end(), expected_words.begin(), expected_words.end())) {
+                throw logic_error(stage + ": MatchDocument returned other words for \""s + raw_query + "\""s);
+            }
+        }
+    }
+
+    CheckPagination(search_server, documents, stage);
+    CheckBatchSearch(search_server, documents, stage);
+    CheckResultCache(search_server, documents, stage);
+}
+
+// Ids of the documents the removal checks take out of the corpus, a third of it and one of the demo documents.
+// The corpus is in id order, so are they.
+vector<int> GetRemovedExampleIds(const vector<ExampleDocument>& documents) {
+    vector<int> removed_ids;
+    for (const ExampleDocument& document : documents) {
+        if (document.id % 3 == 0 || document.id == 2) {
+            removed_ids.push_back(document.id);
+        }
+    }
+    return removed_ids;
+}
+
+vector<ExampleDocument> RemoveExampleDocuments(vector<ExampleDocument> documents, const vector<int>& removed_ids) {
+    documents.erase(remove_if(documents.begin(), documents.end(), [&removed_ids](const ExampleDocument& document) {
+        return binary_search(removed_ids.begin(), removed_ids.end(), document.id);
+        }), documents.end());
+    return documents;
+}
+
+// Removes the documents of GetRemovedExampleIds from a server holding all of them, searching the tombstoned
+// and then the compacted index. Returns the documents left.
+vector<ExampleDocument> CheckRemoval(SearchServer& search_server, const vector<ExampleDocument>& documents) {
+    const vector<int> removed_ids = GetRemovedExampleIds(documents);
+    const vector<ExampleDocument> remaining = RemoveExampleDocuments(documents, removed_ids);
+    search_server.RemoveDocument(removed_ids.front());
+    search_server.RemoveDocuments({ removed_ids.begin() + 1, removed_ids.end() });
+    CheckSearchPaths(search_server, remaining, "Removed documents"s);
+    search_server.CompactIndex();
+    CheckSearchPaths(search_server, remaining, "Compacted index"s);
+    return remaining;
+}
+
+// A snapshot loads into a server with the same results under both verifications, a loaded server saves the same
+// bytes again, and a file cut short is rejected
+void CheckSnapshot(const SearchServer& search_server, const vector<ExampleDocument>& documents) {
+    const filesystem::path directory = filesystem::temp_directory_path();
+    const string snapshot_path = (directory / "search_server_test.snapshot"s).string();
+    const string copy_path = (directory / "search_server_test_copy.snapshot"s).string();
+    const auto read_file = [](const string& path) {
+        ifstream input(path, ios::binary);
+        return string(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    };
+    try {
+        search_server.SaveSnapshot(snapshot_path);
+        {
+            const SearchServer full_server = SearchServer::LoadSnapshot(snapshot_path, SnapshotVerification::FULL);
+            CheckSearchPaths(full_server, documents, "Loaded snapshot"s);
+            const SearchServer header_server = SearchServer::LoadSnapshot(snapshot_path, SnapshotVerification::HEADER);
+            CheckSearchPaths(header_server, documents, "Loaded snapshot with the header checked"s);
+            header_server.SaveSnapshot(copy_path);
+        }
+        const string snapshot = read_file(snapshot_path);
+        if (snapshot != read_file(copy_path)) {
+            throw logic_error("A loaded snapshot was saved with other bytes"s);
+        }
+        filesystem::resize_file(copy_path, snapshot.size() / 2);
+        try {
+            SearchServer::LoadSnapshot(copy_path);
+            throw logic_error("A snapshot cut short was loaded"s);
+        }
+        catch (const runtime_error&) {
+        }
+    }
+    catch (...) {
+        remove(snapshot_path.c_str());
+        remove(copy_path.c_str());
+        throw;
+    }
+    remove(snapshot_path.c_str());
+    remove(copy_path.c_str());
+}
+
+// ShardedSearchServer finds what one server holding all the documents finds, also after removals
+void CheckShardedSearch(const vector<ExampleDocument>& documents) {
+    ShardedSearchServer sharded_server(EXAMPLE_STOP_WORDS, 3);
+    const size_t half = documents.size() / 2;
+    vector<DocumentInput> batch;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const ExampleDocument& document = documents[i];
+        if (i < half) {
+            sharded_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        else {
+            batch.push_back({ document.id, document.text, document.status, document.ratings });
+        }
+    }
+    sharded_server.AddDocuments(batch);
+    const vector<int> removed_ids = GetRemovedExampleIds(documents);
+    sharded_server.RemoveDocuments(removed_ids);
+    const vector<ExampleDocument> remaining = RemoveExampleDocuments(documents, removed_ids);
+    if (sharded_server.GetDocumentCount() != static_cast<int>(remaining.size())) {
+        throw logic_error("ShardedSearchServer holds another number of documents"s);
+    }
+
+    const auto is_actual = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::ACTUAL;
+    };
+    const auto is_banned = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::BANNED;
+    };
+    const auto is_even = [](int document_id, DocumentStatus, int) {
+        return document_id % 2 == 0;
+    };
+    for (const string& raw_query : EXAMPLE_QUERIES) {
+        CheckSameDocuments(FindExampleTopDocuments(remaining, raw_query, is_actual), sharded_server.FindTopDocuments(raw_query),
+            "ShardedSearchServer"s, raw_query);
+        CheckSameDocuments(FindExampleTopDocuments(remaining, raw_query, is_banned),
+            sharded_server.FindTopDocuments(raw_query, DocumentStatus::BANNED), "ShardedSearchServer by status"s, raw_query);
+        CheckSameDocuments(FindExampleTopDocuments(remaining, raw_query, is_even, 20), sharded_server.FindTopDocuments(raw_query, is_even, 20),
+            "ShardedSearchServer by predicate"s, raw_query);
+        for (const int document_id : { 1, 4, 40, 41 }) {
+            const auto document = find_if(remaining.begin(), remaining.end(), [document_id](const ExampleDocument& document) {
+                return document.id == document_id;
+                });
+            const auto [words, status] = sharded_server.MatchDocument(raw_query, document_id);
+            const vector<string> expected_words = MatchExampleDocument(*document, raw_query);
+            if (status != document->status || !equal(words.begin(), words.end(), expected_words.begin(), expected_words.end())) {
+                throw logic_error("ShardedSearchServer: MatchDocument returned other words for \""s + raw_query + "\""s);
+            }
+        }
+    }
+}
+
+// ConcurrentSearchServer answers like SearchServer, and a reader searching while a batch of documents is removed
+// sees the index either before or after the batch
+void CheckConcurrentServer(const vector<ExampleDocument>& documents) {
+    ConcurrentSearchServer concurrent_server(EXAMPLE_STOP_WORDS);
+    concurrent_server.SetWorkerCount(2);
+    for (const ExampleDocument& document : documents) {
+        concurrent_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    const vector<int> removed_ids = GetRemovedExampleIds(documents);
+    const vector<ExampleDocument> remaining = RemoveExampleDocuments(documents, removed_ids);
+    const auto is_actual = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::ACTUAL;
+    };
+    const string& raw_query = EXAMPLE_QUERIES.front();
+    const vector<Document> expected_before = FindExampleTopDocuments(documents, raw_query, is_actual);
+    const vector<Document> expected_after = FindExampleTopDocuments(remaining, raw_query, is_actual);
+
+    atomic<bool> is_removed{ false };
+    string reader_error;
+    thread reader([&]() {
+        try {
+            do {
+                const auto snapshot = concurrent_server.GetSnapshot();
+                const bool is_before = snapshot->GetDocumentCount() == static_cast<int>(documents.size());
+                if (!is_before && snapshot->GetDocumentCount() != static_cast<int>(remaining.size())) {
+                    reader_error = "a reader saw a part of a removal"s;
+                }
+                else if (!IsSameDocuments(is_before ? expected_before : expected_after, snapshot->FindTopDocuments(raw_query))) {
+                    reader_error = "a reader found other documents than its version holds"s;
+                }
+            } while (!is_removed && reader_error.empty());
+        }
+        catch (const exception& error) {
+            reader_error = error.what();
+        }
+        });
+    concurrent_server.RemoveDocuments(removed_ids);
+    is_removed = true;
+    reader.join();
+    if (!reader_error.empty()) {
+        throw logic_error("ConcurrentSearchServer: "s + reader_error);
+    }
+
+    for (const string& query : EXAMPLE_QUERIES) {
+        CheckSameDocuments(FindExampleTopDocuments(remaining, query, is_actual), concurrent_server.FindTopDocuments(query),
+            "ConcurrentSearchServer"s, query);
+        CheckSameDocuments(FindExampleTopDocuments(remaining, query, is_actual), concurrent_server.FindTopDocuments(execution::par, query),
+            "ConcurrentSearchServer: parallel FindTopDocuments"s, query);
+    }
+}
+
+// Both tokenizers split like SplitIntoWordsView
+void CheckTokenizer(const vector<ExampleDocument>& documents) {
+    vector<string_view> words;
+    for (const ExampleDocument& document : documents) {
+        if (TokenizeWords(document.text, words) != NO_INVALID_WORD || words != SplitIntoWordsView(document.text)
+            || TokenizeWordsScalar(document.text, words) != NO_INVALID_WORD || words != SplitIntoWordsView(document.text)) {
+            throw logic_error("TokenizeWords split \""s + document.text + "\" in another way"s);
+        }
+    }
+    const vector<pair<string_view, size_t>> invalid_texts = { { "cat d\x01g"sv, 1 }, { "\x1f"sv, 0 }, { "white cat \x02 hat"sv, 2 } };
+    for (const auto& [text, invalid_word] : invalid_texts) {
+        if (TokenizeWords(text, words) != invalid_word || TokenizeWordsScalar(text, words) != invalid_word) {
+            throw logic_error("TokenizeWords found another invalid word in \""s + string(text) + "\""s);
+        }
+    }
+}
+
+// A batch holds the same documents as one added document by document, a batch with a bad id adds nothing
+void CheckAddDocuments(const vector<ExampleDocument>& documents) {
+    vector<DocumentInput> batch;
+    for (const ExampleDocument& document : documents) {
+        batch.push_back({ document.id, document.text, document.status, document.ratings });
+    }
+    SearchServer search_server(EXAMPLE_STOP_WORDS);
+    const size_t half = batch.size() / 2;
+    search_server.AddDocuments({ batch.begin(), batch.begin() + half });
+    vector<DocumentInput> rejected(batch.begin() + half, batch.end());
+    rejected.push_back(batch.front());
+    try {
+        search_server.AddDocuments(rejected);
+        throw logic_error("AddDocuments accepted a batch with a taken id"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    if (search_server.GetDocumentCount() != static_cast<int>(half)) {
+        throw logic_error("AddDocuments added a part of a rejected batch"s);
+    }
+    search_server.AddDocuments({ batch.begin() + half, batch.end() });
+    CheckSearchPaths(search_server, documents, "Documents added in batches"s);
+}
+
+// The documents written as lines of the ParseDocumentLine format and loaded in small chunks
+void CheckIngestion(const vector<ExampleDocument>& documents) {
+    string input;
+    for (const ExampleDocument& document : documents) {
+        input += to_string(document.id) + '\t' + GetExampleStatusName(document.status) + '\t';
+        for (size_t i = 0; i < document.ratings.size(); ++i) {
+            input += (i > 0 ? ","s : ""s) + to_string(document.ratings[i]);
+        }
+        input += '\t' + document.text + '\n';
+    }
+    SearchServer loaded_server(EXAMPLE_STOP_WORDS);
+    IngestionOptions options;
+    options.chunk_size = 4096;
+    istringstream input_stream(input);
+    IngestionPipeline(loaded_server, options).LoadStream(input_stream);
+    CheckSearchPaths(loaded_server, documents, "Ingested documents"s);
+}
+
+// Request and response frames of every query parse back into what was written, an error frame too
+void CheckQueryProtocol(const vector<ExampleDocument>& documents) {
+    const auto is_actual = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::ACTUAL;
+    };
+    for (const string& raw_query : EXAMPLE_QUERIES) {
+        const vector<Document> expected = FindExampleTopDocuments(documents, raw_query, is_actual);
+        string frames;
+        AppendQueryFrame(frames, 7, raw_query);
+        AppendResponseFrame(frames, 7, expected.begin(), expected.end());
+        string_view buffer = frames;
+        const optional<string_view> request_payload = TakeFrame(buffer);
+        const optional<string_view> response_payload = TakeFrame(buffer);
+        if (!request_payload || !response_payload || !buffer.empty()) {
+            throw logic_error("Query protocol frames were cut in another way"s);
+        }
+        const QueryRequest request = ParseQueryRequest(*request_payload);
+        const QueryResponse response = ParseQueryResponse(*response_payload);
+        if (request.request_id != 7 || request.query != raw_query || response.request_id != 7 || response.status != QueryResponseStatus::OK) {
+            throw logic_error("Query protocol frames were parsed in another way"s);
+        }
+        CheckSameDocuments(expected, response.documents, "Query protocol"s, raw_query);
+    }
+
+    string frame;
+    AppendErrorFrame(frame, 8, QueryResponseStatus::INVALID_QUERY, "Query word is empty"sv);
+    string_view buffer = frame;
+    const optional<string_view> payload = TakeFrame(buffer);
+    // A frame cut short is not taken until the rest arrives
+    string_view partial = string_view(frame).substr(0, frame.size() - 1);
+    if (!payload || TakeFrame(partial)) {
+        throw logic_error("Query protocol error frame was cut in another way"s);
+    }
+    const QueryResponse response = ParseQueryResponse(*payload);
+    if (response.request_id != 8 || response.status != QueryResponseStatus::INVALID_QUERY || response.error != "Query word is empty"s) {
+        throw logic_error("Query protocol error frame was parsed in another way"s);
+    }
+}
+
+#ifdef __linux__
+// Shard workers run on threads of this process, the requests go over their sockets as they would to worker processes
+void CheckRemoteShards(vector<ExampleDocument> documents) {
+    const size_t shard_count = 3;
+    vector<unique_ptr<SearchServer>> shard_servers;
+    vector<unique_ptr<ShardWorker>> workers;
+    vector<string> socket_paths;
+    vector<thread> worker_threads;
+    const auto stop_workers = [&workers, &worker_threads]() {
+        for (size_t i = 0; i < worker_threads.size(); ++i) {
+            workers[i]->Stop();
+            worker_threads[i].join();
+        }
+    };
+    try {
+        for (size_t i = 0; i < shard_count; ++i) {
+            socket_paths.push_back((filesystem::temp_directory_path() / ("search_server_test_shard"s + to_string(i) + ".sock"s)).string());
+            shard_servers.push_back(make_unique<SearchServer>(EXAMPLE_STOP_WORDS));
+            workers.push_back(make_unique<ShardWorker>(*shard_servers.back(), socket_paths.back()));
+            worker_threads.emplace_back([&worker = *workers.back()]() {
+                worker.Run();
+                });
+        }
+
+        RemoteShardedSearchServer remote_server(socket_paths);
+        for (const ExampleDocument& document : documents) {
+            remote_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        vector<int> removed_ids;
+        for (const ExampleDocument& document : documents) {
+            if (document.id % 5 == 1) {
+                removed_ids.push_back(document.id);
+            }
+        }
+        remote_server.RemoveDocuments(removed_ids);
+        documents.erase(remove_if(documents.begin(), documents.end(), [](const ExampleDocument& document) {
+            return document.id % 5 == 1;
+            }), documents.end());
+        if (remote_server.GetDocumentCount() != static_cast<int>(documents.size())) {
+            throw logic_error("RemoteShardedSearchServer holds another number of documents"s);
+        }
+
+        const auto is_actual = [](int, DocumentStatus status, int) {
+            return status == DocumentStatus::ACTUAL;
+        };
+        const auto is_banned = [](int, DocumentStatus status, int) {
+            return status == DocumentStatus::BANNED;
+        };
+        for (const string& raw_query : EXAMPLE_QUERIES) {
+            CheckSameDocuments(FindExampleTopDocuments(documents, raw_query, is_actual), remote_server.FindTopDocuments(raw_query),
+                "RemoteShardedSearchServer"s, raw_query);
+            CheckSameDocuments(FindExampleTopDocuments(documents, raw_query, is_banned),
+                remote_server.FindTopDocuments(raw_query, DocumentStatus::BANNED), "RemoteShardedSearchServer by status"s, raw_query);
+            for (const ExampleDocument& document : documents) {
+                const auto [words, status] = remote_server.MatchDocument(raw_query, document.id);
+                if (status != document.status || words != MatchExampleDocument(document, raw_query)) {
+                    throw logic_error("RemoteShardedSearchServer: MatchDocument returned other words for \""s + raw_query + "\""s);
+                }
+            }
+        }
+        try {
+            remote_server.FindTopDocuments("curly --cat"s);
+            throw logic_error("RemoteShardedSearchServer accepted an invalid query"s);
+        }
+        catch (const invalid_argument&) {
+        }
+        try {
+            remote_server.MatchDocument("curly"s, removed_ids.front());
+            throw logic_error("RemoteShardedSearchServer matched a removed document"s);
+        }
+        catch (const out_of_range&) {
+        }
+    }
+    catch (...) {
+        stop_workers();
+        throw;
+    }
+    stop_workers();
+}
+#endif
+
+} // namespace
+
+void TestSearchServer() {
+    vector<ExampleDocument> documents = MakeExampleDocuments();
+    SearchServer search_server(EXAMPLE_STOP_WORDS);
+    for (const ExampleDocument& document : documents) {
+        search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    CheckTokenizer(documents);
+    CheckSearchPaths(search_server, documents, "Added documents"s);
+    CheckAddDocuments(documents);
+    CheckIngestion(documents);
+    CheckShardedSearch(documents);
+    CheckConcurrentServer(documents);
+
+    documents = CheckRemoval(search_server, documents);
+    CheckSnapshot(search_server, documents);
+    CheckQueryProtocol(documents);
+#ifdef __linux__
+    CheckRemoteShards(documents);
+#endif
+}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <optional>
 #include <vector>
 #include <string>
+#include <utility>
 
 #include "document.h"
 #include "search_server.h"
@@ -17,7 +19,29 @@ void FindTopDocuments(const SearchServer& search_server, const std::string& raw_
 
 void MatchDocuments(const SearchServer& search_server, const std::string& query);
 
+// Runs every search path of the server on a corpus built around the demo documents and compares the results
+// with a straightforward TF-IDF search, the way the server searched before it had an inverted index.
+// The sequential and parallel searches by status and by predicate and MatchDocument are compared at every stage:
+// after adding, removing and compacting, and on copies built by batches, ingestion and snapshots. Pagination,
+// batch search and the result cache are checked along with them. The tokenizer, sharded and remote sharded
+// searches, the concurrent server and the query protocol have checks of their own.
+// Throws std::logic_error naming the first path that returned something else.
+void TestSearchServer();
+
 template <typename Container>
 auto Paginate(const Container& c, std::size_t page_size) {
     return Paginator(std::begin(c), std::end(c), page_size);
-}
\ No newline at end of file
+}
+
+// Pages of the ACTUAL results of a query, each one found with FindTopDocumentsAfter when the iteration reaches it
+inline auto PaginateSearch(const SearchServer& search_server, std::string raw_query, std::size_t page_size) {
+    return LazyPaginator([&search_server, raw_query = std::move(raw_query), page_size, cursor = std::optional<ResultCursor>()]() mutable {
+        std::vector<Document> page = cursor
+            ? search_server.FindTopDocumentsAfter(raw_query, DocumentStatus::ACTUAL, *cursor, page_size)
+            : search_server.FindTopDocumentsPage(raw_query, DocumentStatus::ACTUAL, 0, page_size);
+        if (!page.empty()) {
+            cursor = ResultCursor(page.back());
+        }
+        return page;
+        });
+}
@@ -0,0 +1,88 @@
+#include <algorithm>
+
+#include "text_arena.h"
+
+using namespace std;
+
+TextArena::TextArena(size_t chunk_size)
+    : chunk_size_(max<size_t>(chunk_size, 1)) {
+}
+
+string_view TextArena::Append(string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+    Chunk* chunk = current_chunk_;
+    if (text.size() > chunk_size_ / 4) {
+        // Large texts get a chunk of their own instead of wasting the rest of the current one
+        chunk = &AddChunk(text.size());
+    }
+    else if (chunk == nullptr || chunk->capacity - chunk->size < text.size()) {
+        chunk = &AddChunk(chunk_size_);
+        current_chunk_ = chunk;
+    }
+    char* stored_text = chunk->data.get() + chunk->size;
+    copy(text.begin(), text.end(), stored_text);
+    chunk->size += text.size();
+    chunk->live_bytes += text.size();
+    live_bytes_ += text.size();
+    return { stored_text, text.size() };
+}
+
+void TextArena::Release(string_view text) {
+    if (text.empty()) {
+        return;
+    }
+    const char* chunk_start = FindChunkStart(text);
+    if (chunk_start == nullptr) {
+        return;
+    }
+    const auto chunk_it = chunks_.find(chunk_start);
+    Chunk& chunk = chunk_it->second;
+    chunk.live_bytes -= text.size();
+    live_bytes_ -= text.size();
+    if (chunk.live_bytes > 0) {
+        return;
+    }
+    if (&chunk == current_chunk_) {
+        // Nothing refers to the current chunk any more, so appending can start over
+        chunk.size = 0;
+        return;
+    }
+    allocated_bytes_ -= chunk.capacity;
+    chunks_.erase(chunk_it);
+}
+
+bool TextArena::Contains(string_view text) const {
+    return !text.empty() && FindChunkStart(text) != nullptr;
+}
+
+size_t TextArena::GetAllocatedBytes() const {
+    return allocated_bytes_;
+}
+
+size_t TextArena::GetLiveBytes() const {
+    return live_bytes_;
+}
+
+TextArena::Chunk& TextArena::AddChunk(size_t capacity) {
+    unique_ptr<char[]> data(new char[capacity]);
+    const char* key = data.get();
+    Chunk& chunk = chunks_[key];
+    chunk.data = move(data);
+    chunk.capacity = capacity;
+    allocated_bytes_ += capacity;
+    return chunk;
+}
+
+const char* TextArena::FindChunkStart(string_view text) const {
+    auto chunk_it = chunks_.upper_bound(text.data());
+    if (chunk_it == chunks_.begin()) {
+        return nullptr;
+    }
+    --chunk_it;
+    if (text.data() >= chunk_it->first + chunk_it->second.size) {
+        return nullptr;
+    }
+    return chunk_it->first;
+}
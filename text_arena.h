@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string_view>
+
+// Append-only storage of texts in large chunks. Stored text never moves, so the views handed out stay valid
+// until the text is released. Released space is not reused piecemeal: a chunk is freed as a whole once
+// every text in it has been released.
+class TextArena {
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = size_t{ 1 } << 20;
+
+    explicit TextArena(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+    TextArena(const TextArena&) = delete;
+
+    TextArena& operator=(const TextArena&) = delete;
+
+    TextArena(TextArena&&) = default;
+
+    TextArena& operator=(TextArena&&) = default;
+
+    std::string_view Append(std::string_view text);
+
+    // Views that were not returned by Append, such as texts of a mapped snapshot, are ignored
+    void Release(std::string_view text);
+
+    // Whether the view was returned by Append and points into a chunk of this arena
+    bool Contains(std::string_view text) const;
+
+    // Bytes held by chunks, including released texts in chunks that are still partly in use
+    size_t GetAllocatedBytes() const;
+
+    // Bytes of texts that have not been released
+    size_t GetLiveBytes() const;
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t capacity = 0;
+        size_t size = 0;
+        size_t live_bytes = 0;
+    };
+
+    size_t chunk_size_;
+    // Keyed by the start of the chunk memory, so the chunk of a view is found by its address
+    std::map<const char*, Chunk> chunks_;
+    // The chunk new texts are appended to, nullptr before the first one
+    Chunk* current_chunk_ = nullptr;
+    size_t allocated_bytes_ = 0;
+    size_t live_bytes_ = 0;
+
+    Chunk& AddChunk(size_t capacity);
+
+    // The start of the chunk holding the text, nullptr if there is none
+    const char* FindChunkStart(std::string_view text) const;
+};
@@ -0,0 +1,220 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+namespace {
+
+// The pool and worker index of the calling thread
+thread_local const WorkStealingPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(size_t worker_count)
+    : start_time_(chrono::steady_clock::now()) {
+    worker_count = max<size_t>(worker_count, 1);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(make_unique<Worker>());
+    }
+    for (size_t i = 0; i < worker_count; ++i) {
+        threads_.emplace_back([this, i]() {
+            WorkerLoop(i);
+            });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        lock_guard guard(sleep_mutex_);
+        is_stopping_ = true;
+    }
+    wake_up_.notify_all();
+    for (thread& worker_thread : threads_) {
+        worker_thread.join();
+    }
+}
+
+size_t WorkStealingPool::GetDefaultWorkerCount() {
+    return max(1u, thread::hardware_concurrency());
+}
+
+const shared_ptr<WorkStealingPool>& WorkStealingPool::GetDefault() {
+    static const shared_ptr<WorkStealingPool> pool = make_shared<WorkStealingPool>();
+    return pool;
+}
+
+size_t WorkStealingPool::GetWorkerCount() const {
+    return workers_.size();
+}
+
+vector<WorkStealingPool::WorkerStats> WorkStealingPool::GetWorkerStats() const {
+    vector<WorkerStats> stats(workers_.size());
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        stats[i].executed_tasks = workers_[i]->executed_tasks.load(memory_order_relaxed);
+        stats[i].stolen_tasks = workers_[i]->stolen_tasks.load(memory_order_relaxed);
+        stats[i].busy_time = chrono::nanoseconds(workers_[i]->busy_nanoseconds.load(memory_order_relaxed));
+    }
+    return stats;
+}
+
+chrono::nanoseconds WorkStealingPool::GetUptime() const {
+    return chrono::steady_clock::now() - start_time_;
+}
+
+size_t WorkStealingPool::GetCurrentWorker() const {
+    return current_pool == this ? current_worker : NO_WORKER;
+}
+
+void WorkStealingPool::Submit(vector<Task>& tasks) {
+    // Counted before they are visible, so a thread that takes a task never sees the counter go below zero
+    queued_tasks_.fetch_add(tasks.size(), memory_order_release);
+    const size_t worker_index = GetCurrentWorker();
+    if (worker_index != NO_WORKER) {
+        // Other workers steal from the front, so they take the first tasks and the owner starts from the last one
+        Worker& worker = *workers_[worker_index];
+        lock_guard guard(worker.mutex);
+        for (Task& task : tasks) {
+            worker.tasks.push_back(move(task));
+        }
+    }
+    else {
+        const size_t first_worker = next_worker_.fetch_add(1, memory_order_relaxed);
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            Worker& worker = *workers_[(first_worker + i) % workers_.size()];
+            lock_guard guard(worker.mutex);
+            worker.tasks.push_back(move(tasks[i]));
+        }
+    }
+    {
+        // Taking the mutex orders the counter update with a worker that is about to sleep
+        lock_guard guard(sleep_mutex_);
+    }
+    wake_up_.notify_all();
+    // Workers sleeping in Wait can take the new tasks as well
+    group_done_.notify_all();
+}
+
+bool WorkStealingPool::TryRunTask(size_t worker_index) {
+    if (queued_tasks_.load(memory_order_acquire) == 0) {
+        return false;
+    }
+    if (worker_index != NO_WORKER) {
+        Worker& worker = *workers_[worker_index];
+        unique_lock lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            Task task = move(worker.tasks.back());
+            worker.tasks.pop_back();
+            lock.unlock();
+            queued_tasks_.fetch_sub(1, memory_order_relaxed);
+            RunTask(task, worker_index, false);
+            return true;
+        }
+    }
+    const size_t first_victim = worker_index == NO_WORKER ? next_worker_.load(memory_order_relaxed) : worker_index + 1;
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        const size_t victim_index = (first_victim + i) % workers_.size();
+        if (victim_index == worker_index) {
+            continue;
+        }
+        Worker& victim = *workers_[victim_index];
+        unique_lock lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            Task task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            lock.unlock();
+            queued_tasks_.fetch_sub(1, memory_order_relaxed);
+            RunTask(task, worker_index, true);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkStealingPool::TryRunGroupTask(const TaskGroup& group) {
+    if (queued_tasks_.load(memory_order_acquire) == 0) {
+        return false;
+    }
+    for (const unique_ptr<Worker>& worker : workers_) {
+        unique_lock lock(worker->mutex);
+        const auto it = find_if(worker->tasks.begin(), worker->tasks.end(), [&group](const Task& task) {
+            return task.group == &group;
+            });
+        if (it != worker->tasks.end()) {
+            Task task = move(*it);
+            worker->tasks.erase(it);
+            lock.unlock();
+            queued_tasks_.fetch_sub(1, memory_order_relaxed);
+            RunTask(task, NO_WORKER, false);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::RunTask(Task& task, size_t worker_index, bool is_stolen) {
+    const auto start = chrono::steady_clock::now();
+    try {
+        task.func();
+    }
+    catch (...) {
+        lock_guard guard(task.group->exception_mutex);
+        if (!task.group->exception) {
+            task.group->exception = current_exception();
+        }
+    }
+    if (worker_index != NO_WORKER) {
+        Worker& worker = *workers_[worker_index];
+        worker.executed_tasks.fetch_add(1, memory_order_relaxed);
+        if (is_stolen) {
+            worker.stolen_tasks.fetch_add(1, memory_order_relaxed);
+        }
+        worker.busy_nanoseconds.fetch_add(
+            static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count()),
+            memory_order_relaxed);
+    }
+    // The group lives on the stack of the waiting thread, it must not be touched after this
+    if (task.group->pending_tasks.fetch_sub(1, memory_order_acq_rel) == 1) {
+        {
+            // Orders the last decrement with a waiter that is about to sleep
+            lock_guard guard(sleep_mutex_);
+        }
+        group_done_.notify_all();
+    }
+}
+
+void WorkStealingPool::Wait(TaskGroup& group) {
+    const size_t worker_index = GetCurrentWorker();
+    while (group.pending_tasks.load(memory_order_acquire) > 0) {
+        const bool has_run_task = worker_index != NO_WORKER ? TryRunTask(worker_index) : TryRunGroupTask(group);
+        if (has_run_task) {
+            continue;
+        }
+        // The remaining tasks of the group are running on other threads. A worker also wakes up for new tasks,
+        // which may be the nested tasks of the ones it waits for.
+        unique_lock lock(sleep_mutex_);
+        group_done_.wait(lock, [this, &group, worker_index]() {
+            return group.pending_tasks.load(memory_order_acquire) == 0
+                || (worker_index != NO_WORKER && queued_tasks_.load(memory_order_acquire) > 0);
+            });
+    }
+    if (group.exception) {
+        rethrow_exception(group.exception);
+    }
+}
+
+void WorkStealingPool::WorkerLoop(size_t worker_index) {
+    current_pool = this;
+    current_worker = worker_index;
+    while (true) {
+        if (TryRunTask(worker_index)) {
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this]() {
+            return is_stopping_ || queued_tasks_.load(memory_order_acquire) > 0;
+            });
+        if (is_stopping_ && queued_tasks_.load(memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with a task deque each.
+// A worker runs its own newest task first and steals the oldest task of another worker when its deque is empty.
+// A worker waiting for a nested parallel loop runs queued tasks first, so nested loops neither deadlock
+// nor start additional threads. A thread outside the pool only helps with the tasks of its own loop.
+// Once there is nothing left to run, a waiting thread sleeps until its loop is done or new tasks arrive.
+class WorkStealingPool {
+public:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    struct WorkerStats {
+        uint64_t executed_tasks = 0;
+        // Tasks taken from the deques of other workers, included in executed_tasks
+        uint64_t stolen_tasks = 0;
+        std::chrono::nanoseconds busy_time{ 0 };
+    };
+
+    explicit WorkStealingPool(size_t worker_count = GetDefaultWorkerCount());
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool();
+
+    static size_t GetDefaultWorkerCount();
+
+    // Process-wide pool for everything that is not given a pool of its own
+    static const std::shared_ptr<WorkStealingPool>& GetDefault();
+
+    size_t GetWorkerCount() const;
+
+    // Calls func(i) for every i in [first, last) and returns once all the calls are done.
+    // Consecutive indices are run by one task in groups of grain_size, 0 lets the pool pick a size.
+    // The first exception thrown by func is rethrown here after the other tasks have finished.
+    template <typename Func>
+    void ParallelFor(size_t first, size_t last, Func func, size_t grain_size = 0);
+
+    std::vector<WorkerStats> GetWorkerStats() const;
+
+    // Time since the pool was started, busy_time / uptime is the utilization of a worker
+    std::chrono::nanoseconds GetUptime() const;
+
+private:
+    struct TaskGroup {
+        std::atomic<size_t> pending_tasks{ 0 };
+        std::mutex exception_mutex;
+        std::exception_ptr exception;
+    };
+
+    struct Task {
+        std::function<void()> func;
+        TaskGroup* group;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<uint64_t> executed_tasks{ 0 };
+        std::atomic<uint64_t> stolen_tasks{ 0 };
+        std::atomic<uint64_t> busy_nanoseconds{ 0 };
+    };
+
+    static constexpr size_t NO_WORKER = static_cast<size_t>(-1);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> queued_tasks_{ 0 };
+    std::atomic<size_t> next_worker_{ 0 };
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    // Notified under sleep_mutex_ when a group finishes or tasks are submitted, for threads inside Wait
+    std::condition_variable group_done_;
+    bool is_stopping_ = false;
+    const std::chrono::steady_clock::time_point start_time_;
+
+    // Index of the calling thread among the workers of this pool, NO_WORKER for other threads
+    size_t GetCurrentWorker() const;
+
+    void Submit(std::vector<Task>& tasks);
+
+    // Runs one queued task if there is any, the own deque of worker_index is tried first
+    bool TryRunTask(size_t worker_index);
+
+    // Runs one queued task of the group, for threads outside the pool that must not pick up unrelated work
+    bool TryRunGroupTask(const TaskGroup& group);
+
+    void RunTask(Task& task, size_t worker_index, bool is_stolen);
+
+    // Helps with queued tasks and then sleeps until every task of the group is done
+    void Wait(TaskGroup& group);
+
+    void WorkerLoop(size_t worker_index);
+};
+
+template <typename Func>
+void WorkStealingPool::ParallelFor(size_t first, size_t last, Func func, size_t grain_size) {
+    if (first >= last) {
+        return;
+    }
+    const size_t count = last - first;
+    if (grain_size == 0) {
+        // A few tasks per worker leave room for balancing uneven tasks
+        grain_size = std::max<size_t>(1, count / (GetWorkerCount() * 4));
+    }
+    const size_t task_count = (count + grain_size - 1) / grain_size;
+    if (task_count == 1) {
+        for (size_t i = first; i < last; ++i) {
+            func(i);
+        }
+        return;
+    }
+
+    TaskGroup group;
+    group.pending_tasks.store(task_count, std::memory_order_relaxed);
+    std::vector<Task> tasks;
+    tasks.reserve(task_count);
+    for (size_t task_first = first; task_first < last; task_first += grain_size) {
+        const size_t task_last = std::min(last, task_first + grain_size);
+        tasks.push_back({ [&func, task_first, task_last]() {
+            for (size_t i = task_first; i < task_last; ++i) {
+                func(i);
+            }
+            }, &group });
+    }
+    Submit(tasks);
+    Wait(group);
+}
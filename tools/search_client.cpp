@@ -0,0 +1,285 @@
+// Loopback load generator for search_daemon: measures throughput and latency percentiles on one machine.
+//
+//   search_client SOCKET_PATH QUERIES_FILE [--requests N] [--connections N] [--depth N] [--print]
+//
+// Every line of QUERIES_FILE is a query, the queries are sent round-robin until N requests are answered.
+// Each connection keeps up to --depth requests in flight. --print sends every query once and prints the results.
+// Build it with query_protocol.cpp and document.cpp of the repository root.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../query_protocol.h"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+struct ConnectionResult {
+    vector<chrono::nanoseconds> latencies;
+    vector<QueryResponse> responses;
+    uint64_t invalid_query_count = 0;
+};
+
+#ifdef __linux__
+
+class QueryConnection {
+public:
+    explicit QueryConnection(const string& socket_path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+            throw runtime_error("Invalid socket path "s + socket_path);
+        }
+        socket_path.copy(address.sun_path, socket_path.size());
+        fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0 || connect(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            const string error = strerror(errno);
+            if (fd_ >= 0) {
+                close(fd_);
+            }
+            throw runtime_error("Cannot connect to "s + socket_path + ": "s + error);
+        }
+    }
+
+    QueryConnection(const QueryConnection&) = delete;
+
+    QueryConnection& operator=(const QueryConnection&) = delete;
+
+    ~QueryConnection() {
+        close(fd_);
+    }
+
+    void Send(string_view data) {
+        while (!data.empty()) {
+            const ssize_t size = send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+            if (size < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error("Cannot send: "s + strerror(errno));
+            }
+            data.remove_prefix(static_cast<size_t>(size));
+        }
+    }
+
+    // Waits until at least one response has arrived and returns all complete ones
+    vector<QueryResponse> Receive() {
+        vector<QueryResponse> responses;
+        while (responses.empty()) {
+            char buffer[64 * 1024];
+            const ssize_t size = recv(fd_, buffer, sizeof(buffer), 0);
+            if (size < 0 && errno == EINTR) {
+                continue;
+            }
+            if (size <= 0) {
+                throw runtime_error("Connection closed by the daemon"s);
+            }
+            input_.append(buffer, static_cast<size_t>(size));
+            string_view unread(input_);
+            while (const optional<string_view> payload = TakeFrame(unread)) {
+                responses.push_back(ParseQueryResponse(*payload));
+            }
+            input_.erase(0, input_.size() - unread.size());
+        }
+        return responses;
+    }
+
+private:
+    int fd_ = -1;
+    string input_;
+};
+
+// Sends the requests numbered first, first + step, ... below last and waits for all of their responses
+ConnectionResult RunConnection(const string& socket_path, const vector<string>& queries,
+    uint64_t first, uint64_t last, uint64_t step, size_t depth, bool keep_responses) {
+    QueryConnection connection(socket_path);
+    ConnectionResult result;
+    // Send times of the requests in flight, indexed by request id
+    vector<Clock::time_point> send_times;
+    uint64_t next_request = first;
+    size_t in_flight = 0;
+    string frames;
+    while (next_request < last || in_flight > 0) {
+        frames.clear();
+        const Clock::time_point now = Clock::now();
+        for (; next_request < last && in_flight < depth; next_request += step, ++in_flight) {
+            const uint64_t request_id = (next_request - first) / step;
+            if (send_times.size() <= request_id) {
+                send_times.resize(request_id + 1);
+            }
+            send_times[request_id] = now;
+            AppendQueryFrame(frames, request_id, queries[next_request % queries.size()]);
+        }
+        connection.Send(frames);
+        for (QueryResponse& response : connection.Receive()) {
+            result.latencies.push_back(Clock::now() - send_times.at(response.request_id));
+            if (response.status != QueryResponseStatus::OK) {
+                ++result.invalid_query_count;
+            }
+            if (keep_responses) {
+                result.responses.push_back(move(response));
+            }
+            --in_flight;
+        }
+    }
+    return result;
+}
+
+#else
+
+ConnectionResult RunConnection(const string&, const vector<string>&, uint64_t, uint64_t, uint64_t, size_t, bool) {
+    throw runtime_error("search_client needs Unix domain sockets and is only available on Linux"s);
+}
+
+#endif
+
+chrono::nanoseconds GetPercentile(const vector<chrono::nanoseconds>& sorted_latencies, double percentile) {
+    if (sorted_latencies.empty()) {
+        return chrono::nanoseconds(0);
+    }
+    const size_t index = static_cast<size_t>(percentile / 100.0 * (sorted_latencies.size() - 1) + 0.5);
+    return sorted_latencies[index];
+}
+
+double ToMicroseconds(chrono::nanoseconds duration) {
+    return chrono::duration<double, micro>(duration).count();
+}
+
+void PrintUsage() {
+    cerr << "Usage: search_client SOCKET_PATH QUERIES_FILE [--requests N] [--connections N] [--depth N] [--print]"s << endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        PrintUsage();
+        return 1;
+    }
+    const string socket_path = argv[1];
+    uint64_t request_count = 100000;
+    size_t connection_count = 4;
+    size_t depth = 16;
+    bool is_printing = false;
+    vector<string> queries;
+    try {
+        for (int i = 3; i < argc; ++i) {
+            const string flag = argv[i];
+            if (flag == "--print"s) {
+                is_printing = true;
+                continue;
+            }
+            if (i + 1 == argc) {
+                throw invalid_argument("Missing value of "s + flag);
+            }
+            const string value = argv[++i];
+            if (flag == "--requests"s) {
+                request_count = stoull(value);
+            }
+            else if (flag == "--connections"s) {
+                connection_count = max<size_t>(stoul(value), 1);
+            }
+            else if (flag == "--depth"s) {
+                depth = max<size_t>(stoul(value), 1);
+            }
+            else {
+                throw invalid_argument("Unknown option "s + flag);
+            }
+        }
+        ifstream queries_file(argv[2]);
+        if (!queries_file) {
+            throw invalid_argument("Cannot open "s + argv[2]);
+        }
+        for (string query; getline(queries_file, query);) {
+            queries.push_back(move(query));
+        }
+        if (queries.empty()) {
+            throw invalid_argument("No queries in "s + argv[2]);
+        }
+    }
+    catch (const exception& error) {
+        cerr << error.what() << endl;
+        PrintUsage();
+        return 1;
+    }
+
+    try {
+        if (is_printing) {
+            const ConnectionResult result = RunConnection(socket_path, queries, 0, queries.size(), 1, depth, true);
+            for (const QueryResponse& response : result.responses) {
+                cout << queries[response.request_id] << ':' << endl;
+                if (response.status != QueryResponseStatus::OK) {
+                    cout << "  error: "s << response.error << endl;
+                }
+                for (const Document& document : response.documents) {
+                    cout << "  "s << document << endl;
+                }
+            }
+            return 0;
+        }
+
+        vector<ConnectionResult> results(connection_count);
+        vector<thread> connections;
+        atomic<bool> has_failed{ false };
+        const Clock::time_point start_time = Clock::now();
+        for (size_t i = 0; i < connection_count; ++i) {
+            connections.emplace_back([&, i]() {
+                try {
+                    results[i] = RunConnection(socket_path, queries, i, request_count, connection_count, depth, false);
+                }
+                catch (const exception& error) {
+                    cerr << error.what() << endl;
+                    has_failed = true;
+                }
+                });
+        }
+        for (thread& connection : connections) {
+            connection.join();
+        }
+        const chrono::duration<double> elapsed = Clock::now() - start_time;
+        if (has_failed) {
+            return 1;
+        }
+
+        vector<chrono::nanoseconds> latencies;
+        uint64_t invalid_query_count = 0;
+        for (const ConnectionResult& result : results) {
+            latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+            invalid_query_count += result.invalid_query_count;
+        }
+        sort(latencies.begin(), latencies.end());
+        cout << latencies.size() << " requests over "s << connection_count << " connections, depth "s << depth << endl;
+        cout << "throughput: "s << latencies.size() / elapsed.count() << " requests/s"s << endl;
+        cout << "latency us: p50 "s << ToMicroseconds(GetPercentile(latencies, 50.0))
+            << ", p90 "s << ToMicroseconds(GetPercentile(latencies, 90.0))
+            << ", p99 "s << ToMicroseconds(GetPercentile(latencies, 99.0))
+            << ", p99.9 "s << ToMicroseconds(GetPercentile(latencies, 99.9))
+            << ", max "s << ToMicroseconds(GetPercentile(latencies, 100.0)) << endl;
+        if (invalid_query_count > 0) {
+            cout << invalid_query_count << " invalid queries"s << endl;
+        }
+    }
+    catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,182 @@
+// Serves a SearchServer over a Unix domain socket, see QueryDaemon.
+//
+//   search_daemon SOCKET_PATH (--documents FILE | --snapshot FILE) [--stop-words "WORDS"]
+//                 [--batch-size N] [--batch-latency-us N] [--shard INDEX/COUNT]
+//
+// --documents loads lines in the ParseDocumentLine format, --snapshot a file written by SearchServer::SaveSnapshot.
+// --shard serves shard INDEX of COUNT to a RemoteShardedSearchServer with a ShardWorker instead of answering
+// queries: only the documents of that shard are loaded from --documents, a snapshot is loaded as it is, and
+// without either the shard starts empty.
+// Build it with the sources of the repository root except main.cpp, linking TBB and pthreads.
+
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../ingestion_pipeline.h"
+#include "../query_daemon.h"
+#include "../remote_shard.h"
+#include "../search_server.h"
+
+using namespace std;
+
+namespace {
+
+QueryDaemon* running_daemon = nullptr;
+ShardWorker* running_worker = nullptr;
+
+void StopDaemon(int) {
+    if (running_daemon) {
+        running_daemon->Stop();
+    }
+    if (running_worker) {
+        running_worker->Stop();
+    }
+}
+
+void PrintUsage() {
+    cerr << "Usage: search_daemon SOCKET_PATH (--documents FILE | --snapshot FILE) [--stop-words \"WORDS\"]"s
+        << " [--batch-size N] [--batch-latency-us N] [--shard INDEX/COUNT]"s << endl;
+}
+
+struct ShardOption {
+    size_t index = 0;
+    size_t count = 0;
+};
+
+ShardOption ParseShardOption(const string& value) {
+    const size_t slash = value.find('/');
+    if (slash == string::npos) {
+        throw invalid_argument("--shard takes INDEX/COUNT"s);
+    }
+    ShardOption shard{ stoul(value.substr(0, slash)), stoul(value.substr(slash + 1)) };
+    if (shard.index >= shard.count) {
+        throw invalid_argument("Shard index must be less than the shard count"s);
+    }
+    return shard;
+}
+
+// Adds the documents of the shard, the lines of the other shards are parsed but not indexed
+void LoadShardDocuments(SearchServer& search_server, const string& path, ShardOption shard) {
+    ifstream input(path);
+    if (!input) {
+        throw runtime_error("Cannot open "s + path);
+    }
+    vector<string> lines;
+    vector<DocumentInput> documents;
+    for (string line; getline(input, line);) {
+        if (!line.empty() && GetDocumentShardIndex(ParseDocumentLine(line).id, shard.count) == shard.index) {
+            lines.push_back(move(line));
+        }
+    }
+    for (const string& line : lines) {
+        documents.push_back(ParseDocumentLine(line));
+    }
+    search_server.AddDocuments(documents);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        PrintUsage();
+        return 1;
+    }
+    const string socket_path = argv[1];
+    string documents_path;
+    string snapshot_path;
+    string stop_words;
+    QueryDaemonOptions options;
+    optional<ShardOption> shard;
+    try {
+        for (int i = 2; i < argc; ++i) {
+            const string flag = argv[i];
+            if (i + 1 == argc) {
+                throw invalid_argument("Missing value of "s + flag);
+            }
+            const string value = argv[++i];
+            if (flag == "--documents"s) {
+                documents_path = value;
+            }
+            else if (flag == "--snapshot"s) {
+                snapshot_path = value;
+            }
+            else if (flag == "--stop-words"s) {
+                stop_words = value;
+            }
+            else if (flag == "--batch-size"s) {
+                options.max_batch_size = stoul(value);
+            }
+            else if (flag == "--batch-latency-us"s) {
+                options.batch_latency = chrono::microseconds(stol(value));
+            }
+            else if (flag == "--shard"s) {
+                shard = ParseShardOption(value);
+            }
+            else {
+                throw invalid_argument("Unknown option "s + flag);
+            }
+        }
+        if (!documents_path.empty() && !snapshot_path.empty()) {
+            throw invalid_argument("Only one of --documents and --snapshot may be given"s);
+        }
+        if (!shard && documents_path.empty() && snapshot_path.empty()) {
+            throw invalid_argument("One of --documents and --snapshot is required"s);
+        }
+    }
+    catch (const exception& error) {
+        cerr << error.what() << endl;
+        PrintUsage();
+        return 1;
+    }
+
+    try {
+        optional<SearchServer> search_server;
+        if (!snapshot_path.empty()) {
+            search_server.emplace(SearchServer::LoadSnapshot(snapshot_path));
+        }
+        else {
+            search_server.emplace(stop_words);
+            if (shard && !documents_path.empty()) {
+                LoadShardDocuments(*search_server, documents_path, *shard);
+            }
+            else if (!documents_path.empty()) {
+                IngestionPipeline(*search_server).LoadFile(documents_path);
+            }
+        }
+        cerr << "Loaded "s << search_server->GetDocumentCount() << " documents"s << endl;
+
+        if (shard) {
+            ShardWorker worker(*search_server, socket_path);
+            running_worker = &worker;
+            signal(SIGINT, StopDaemon);
+            signal(SIGTERM, StopDaemon);
+            cerr << "Serving shard "s << shard->index << " of "s << shard->count << " on "s << socket_path << endl;
+            worker.Run();
+            running_worker = nullptr;
+            return 0;
+        }
+
+        QueryDaemon daemon(*search_server, socket_path, options);
+        running_daemon = &daemon;
+        signal(SIGINT, StopDaemon);
+        signal(SIGTERM, StopDaemon);
+        cerr << "Serving on "s << socket_path << endl;
+        daemon.Run();
+        running_daemon = nullptr;
+
+        const QueryDaemonStats stats = daemon.GetStats();
+        cerr << "Served "s << stats.request_count << " requests in "s << stats.batch_count << " batches over "s
+            << stats.accepted_connections << " connections, "s << stats.invalid_query_count << " invalid queries, "s
+            << stats.protocol_error_count << " protocol errors"s << endl;
+    }
+    catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+// Keeps the best `capacity` values seen so far, where `compare(lhs, rhs)` means lhs is better than rhs.
+// The values are kept in a heap with the worst kept value on top, so Push costs O(log capacity).
+template <typename Value, typename Compare>
+class TopKSelector {
+public:
+    TopKSelector(size_t capacity, Compare compare)
+        : capacity_(capacity)
+        , compare_(compare) {
+        heap_.reserve(capacity_);
+    }
+
+    void Push(const Value& value) {
+        if (bound_ && !compare_(*bound_, value)) {
+            return;
+        }
+        if (heap_.size() < capacity_) {
+            heap_.push_back(value);
+            std::push_heap(heap_.begin(), heap_.end(), compare_);
+        }
+        else if (capacity_ > 0 && compare_(value, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), compare_);
+            heap_.back() = value;
+            std::push_heap(heap_.begin(), heap_.end(), compare_);
+        }
+    }
+
+    // From now on only values worse than bound are kept, which selects the values following bound in the order
+    void SetBound(const Value& bound) {
+        bound_ = bound;
+    }
+
+    void Merge(const TopKSelector& other) {
+        for (const Value& value : other.heap_) {
+            Push(value);
+        }
+    }
+
+    // Only meaningful when IsFull(): a value that is not better than this one will be rejected
+    const Value& GetWorst() const {
+        return heap_.front();
+    }
+
+    bool IsFull() const {
+        return heap_.size() == capacity_;
+    }
+
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+
+    size_t size() const {
+        return heap_.size();
+    }
+
+    // Returns the kept values from best to worst, the selector is left empty
+    std::vector<Value> ExtractSorted() {
+        std::sort_heap(heap_.begin(), heap_.end(), compare_);
+        std::vector<Value> result = std::move(heap_);
+        heap_.clear();
+        return result;
+    }
+
+private:
+    size_t capacity_;
+    Compare compare_;
+    std::vector<Value> heap_;
+    std::optional<Value> bound_;
+};